@@ -0,0 +1,250 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: benchmark_OMP
+// Description: Microbenchmark for the OpenMP searches of the search
+// library. The benchmark builds synthetic texts in memory and times
+// every registered search engine across a sweep of text sizes, pattern
+// lengths and thread counts. Results are written to stdout as CSV.
+//
+// Usage: benchmark_OMP [options]
+//      -sizes a,b,..     text sizes in characters (default 1048576,16777216,67108864)
+//      -lengths a,b,..   pattern lengths (default 4,16,64)
+//      -threads a,b,..   thread counts (default 1,2,4)
+//      -alphabet n       number of symbols in the text (default 4)
+//      -density d        planted matches per million characters (default 1)
+//      -adversarial 1    use runs of A broken by B like text0 (default 0)
+//      -limit n          occurrences requested from findFirstOccurrences (default 10)
+//      -block n          start positions in each block a thread searches (default 4194304)
+//      -repeats n        timed runs per configuration (default 3)
+//      -seed n           random seed (default 1)
+//
+// The pattern ends with a symbol outside the text alphabet, so apart
+// from the planted copies it never matches and findOccurrence scans
+// the text up to the first planted copy. Set -density 0 to make every
+// engine scan the whole text.
+//
+/////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "search.h"
+#include "synthetic.h"
+
+#define MAX_SWEEP 32
+
+// search engines are registered here so that new engines are timed alongside the existing ones.
+// every thread of the team calls the engine, which returns the result of the search
+typedef int (*SearchEngine)(SearchContext* context, const char* text, int textLength, const char* pattern,
+    int patternLength, SearchResults* results);
+
+typedef struct
+{
+    char* name;
+    SearchEngine search;
+} EngineEntry;
+
+// occurrences requested by search mode 3
+int firstLimit = 10;
+
+void outOfMemory()
+{
+    fprintf(stderr, "Out of memory\n");
+    exit(0);
+}
+
+/// <summary>
+/// Gets the current time in nanoseconds.
+/// </summary>
+/// <returns>The time in nanoseconds.</returns>
+long getNanos()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int findOccurrence(SearchContext* context, const char* text, int textLength, const char* pattern, int patternLength, SearchResults* results)
+{
+    return searchTeam(context, SEARCH_ANY, text, textLength, pattern, patternLength, 1, results, NULL);
+}
+
+int findAllOccurrences(SearchContext* context, const char* text, int textLength, const char* pattern, int patternLength, SearchResults* results)
+{
+    return searchTeam(context, SEARCH_ALL, text, textLength, pattern, patternLength, 1, results, NULL);
+}
+
+int countOccurrences(SearchContext* context, const char* text, int textLength, const char* pattern, int patternLength, SearchResults* results)
+{
+    return searchTeam(context, SEARCH_COUNT, text, textLength, pattern, patternLength, 1, results, NULL);
+}
+
+int findFirstOccurrences(SearchContext* context, const char* text, int textLength, const char* pattern, int patternLength, SearchResults* results)
+{
+    return searchTeam(context, SEARCH_FIRST, text, textLength, pattern, patternLength, firstLimit, results, NULL);
+}
+
+EngineEntry engines[] =
+{
+    { "findOccurrence", findOccurrence },
+    { "findAllOccurrences", findAllOccurrences },
+    { "countOccurrences", countOccurrences },
+    { "findFirstOccurrences", findFirstOccurrences },
+};
+
+/// <summary>
+/// Parses a comma separated list of numbers.
+/// </summary>
+/// <param name="list">The list to parse.</param>
+/// <param name="values">Array to store the parsed values.</param>
+/// <returns>The number of values parsed.</returns>
+int parseList(char* list, long values[])
+{
+    int count = 0;
+    char* end;
+    while (*list && count < MAX_SWEEP)
+    {
+        values[count++] = strtol(list, &end, 10);
+        if (*end != ',')
+            break;
+        list = end + 1;
+    }
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    long sizes[MAX_SWEEP] = { 1048576, 16777216, 67108864 };
+    int sizeCount = 3;
+    long lengths[MAX_SWEEP] = { 4, 16, 64 };
+    int lengthCount = 3;
+    long threads[MAX_SWEEP] = { 1, 2, 4 };
+    int threadCount = 3;
+    int alphabet = 4;
+    double density = 1.0;
+    int adversarial = 0;
+    int repeats = 3;
+    int blockSize = 0;
+    unsigned long long seed = 1;
+
+    int i;
+    for (i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-sizes") == 0)
+            sizeCount = parseList(argv[i + 1], sizes);
+        else if (strcmp(argv[i], "-lengths") == 0)
+            lengthCount = parseList(argv[i + 1], lengths);
+        else if (strcmp(argv[i], "-threads") == 0)
+            threadCount = parseList(argv[i + 1], threads);
+        else if (strcmp(argv[i], "-alphabet") == 0)
+            alphabet = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-density") == 0)
+            density = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-adversarial") == 0)
+            adversarial = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-block") == 0)
+            blockSize = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-limit") == 0)
+            firstLimit = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-repeats") == 0)
+            repeats = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-seed") == 0)
+            seed = strtoull(argv[i + 1], NULL, 10);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (alphabet < 1 || alphabet >= MAX_ALPHABET)
+    {
+        fprintf(stderr, "Alphabet must contain between 1 and %i symbols.\n", MAX_ALPHABET - 1);
+        exit(1);
+    }
+    if (repeats < 1)
+        repeats = 1;
+
+    // locations are stored in an array kept for every search, rather than written anywhere
+    SearchResults results = { NULL, 0, 1, 0, NULL, NULL };
+    int engineCount = sizeof(engines) / sizeof(engines[0]);
+
+    printf("engine,text_bytes,pattern_length,threads,alphabet,best_seconds,mean_seconds,gb_per_s\n");
+
+    int s, l, t, e, r;
+    for (s = 0; s < sizeCount; s++)
+    {
+        char* text = (char*)malloc(sizes[s] * sizeof(char));
+        if (text == NULL)
+            outOfMemory();
+
+        for (l = 0; l < lengthCount; l++)
+        {
+            int patternLength = (int)lengths[l];
+            if (patternLength < 1 || patternLength > sizes[s])
+                continue;
+
+            char* pattern = (char*)malloc(patternLength * sizeof(char));
+            if (pattern == NULL)
+                outOfMemory();
+
+            // rebuild the text for every pattern so planted copies of earlier patterns are removed
+            seedSynthetic(seed);
+            if (adversarial)
+            {
+                fillAdversarialText(text, sizes[s], patternLength + 1);
+                fillAdversarialPattern(pattern, patternLength, 'C');
+            }
+            else
+            {
+                fillRandomText(text, sizes[s], alphabet);
+                fillRandomText(pattern, patternLength, alphabet);
+                pattern[patternLength - 1] = 'A' + alphabet;
+            }
+            plantMatches(text, sizes[s], pattern, patternLength, density);
+
+            for (t = 0; t < threadCount; t++)
+            {
+                SearchContext* context = searchCreate((int)threads[t]);
+                if (context == NULL)
+                    outOfMemory();
+                searchSetBlockSize(context, blockSize);
+                int numThreads = (int)threads[t] < SEARCH_MAX_THREADS ? (int)threads[t] : SEARCH_MAX_THREADS;
+
+                for (e = 0; e < engineCount; e++)
+                {
+                    long best = 0;
+                    long total = 0;
+                    for (r = 0; r < repeats; r++)
+                    {
+                        results.stored = 0;
+
+                        // the engines share their work with the team they are called from
+                        long time = getNanos();
+                        #pragma omp parallel num_threads(numThreads)
+                        engines[e].search(context, text, (int)sizes[s], pattern, patternLength, &results);
+                        time = getNanos() - time;
+
+                        if (r == 0 || time < best)
+                            best = time;
+                        total += time;
+                    }
+
+                    double bestSeconds = (double)best / 1.0e9;
+                    printf("%s,%li,%i,%i,%i,%.09f,%.09f,%.3f\n", engines[e].name, sizes[s], patternLength,
+                        numThreads, adversarial ? 2 : alphabet, bestSeconds, (double)total / repeats / 1.0e9,
+                        bestSeconds > 0 ? (double)sizes[s] / bestSeconds / 1.0e9 : 0.0);
+                    fflush(stdout);
+                }
+                searchDestroy(context);
+            }
+
+            free(pattern);
+        }
+        free(text);
+    }
+    free(results.locations);
+
+    return 0;
+}
@@ -0,0 +1,205 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: checkpoint.h
+// Description: Checkpoints of project_OMP and project_MPI, so a run
+// stopped part way through a long control file, such as by the walltime
+// of a batch job, continues from where it stopped rather than running
+// every test again.
+//
+// Results are written in control order a batch of tests at a time, so
+// after each batch is written every entry before it has its results in
+// the file and none after it has. The checkpoint records the number of
+// those entries and the length of the results file at that point. It is
+// written to a temporary file renamed over the last checkpoint, so a
+// run stopped while writing it leaves the previous checkpoint whole.
+//
+// A resumed run truncates the results file to the length of the
+// checkpoint, dropping the results of any batch written in part, and
+// skips the entries before it. Results of earlier runs appended to the
+// same file are before the checkpoint's length and are kept. A resumed
+// run without a checkpoint empties the results file and starts from the
+// first test, so a batch job passing -resume can be resubmitted as it is.
+//
+// The checkpoint is a text file with the line:
+//      tests length
+//      tests           control entries whose results are written
+//      length          bytes of the results file holding their results
+// Lines starting with # are comments.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifdef DOS
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    long tests;
+    long long length;
+} Checkpoint;
+
+/// <summary>
+/// Gets the length of the results file.
+/// </summary>
+/// <param name="fileName">The results file.</param>
+/// <returns>The length in bytes, 0 if the file does not exist.</returns>
+long long resultsLength(char* fileName)
+{
+#ifdef DOS
+    struct _stat64 s;
+    if (_stat64(fileName, &s) != 0)
+        return 0;
+#else
+    struct stat s;
+    if (stat(fileName, &s) != 0)
+        return 0;
+#endif
+    return (long long)s.st_size;
+}
+
+/// <summary>
+/// Reads a checkpoint written by saveCheckpoint.
+/// </summary>
+/// <param name="fileName">The checkpoint file.</param>
+/// <param name="checkpoint">The checkpoint to fill in.</param>
+/// <returns>1 if a checkpoint was read, otherwise 0.</returns>
+int readCheckpoint(char* fileName, Checkpoint* checkpoint)
+{
+    char line[256];
+    int found = 0;
+    FILE* f = fopen(fileName, "r");
+
+    if (f == NULL)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), f) != NULL)
+    {
+        if (line[0] == '#')
+            continue;
+        found = sscanf(line, "%li %lli", &checkpoint->tests, &checkpoint->length) == 2 &&
+            checkpoint->tests >= 0 && checkpoint->length >= 0;
+    }
+
+    fclose(f);
+    return found;
+}
+
+/// <summary>
+/// Writes a checkpoint, replacing the file only once it is complete.
+/// </summary>
+/// <param name="fileName">The checkpoint file.</param>
+/// <param name="tests">The number of control entries whose results are written.</param>
+/// <param name="length">The length of the results file holding their results.</param>
+/// <returns>1 if the checkpoint was written, otherwise 0.</returns>
+int saveCheckpoint(char* fileName, long tests, long long length)
+{
+    char tempName[1000];
+
+    sprintf(tempName, "%.990s.tmp", fileName);
+    FILE* f = fopen(tempName, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "saveCheckpoint: could not open file %s\n", tempName);
+        return 0;
+    }
+
+    fprintf(f, "# tests length\n%li %lli\n", tests, length);
+    if (fclose(f) != 0)
+    {
+        fprintf(stderr, "saveCheckpoint: could not write file %s\n", tempName);
+        remove(tempName);
+        return 0;
+    }
+
+    // rename does not replace an existing file on DOS
+#ifdef DOS
+    remove(fileName);
+#endif
+    if (rename(tempName, fileName) != 0)
+    {
+        fprintf(stderr, "saveCheckpoint: could not replace file %s\n", fileName);
+        return 0;
+    }
+    return 1;
+}
+
+/// <summary>
+/// Truncates the results file to the length of a checkpoint.
+/// </summary>
+/// <param name="fileName">The results file.</param>
+/// <param name="length">The length to keep.</param>
+/// <returns>1 if the file was truncated, otherwise 0.</returns>
+int truncateResults(char* fileName, long long length)
+{
+#ifdef DOS
+    int fd = _open(fileName, _O_RDWR);
+    int truncated = fd >= 0 && _chsize_s(fd, length) == 0;
+    if (fd >= 0)
+        _close(fd);
+    return truncated;
+#else
+    return truncate(fileName, (off_t)length) == 0;
+#endif
+}
+
+/// <summary>
+/// Starts the checkpoints of a run. A resumed run truncates the results file to the length of the
+/// checkpoint and continues after its tests. Without a checkpoint, nothing of the results file is
+/// known to be complete, so it is emptied and the run starts from the first test. Otherwise a
+/// checkpoint of no tests is written, so a checkpoint of an earlier run is never resumed from.
+/// </summary>
+/// <param name="fileName">The checkpoint file.</param>
+/// <param name="resultsFileName">The results file.</param>
+/// <param name="resume">Whether the run resumes.</param>
+/// <returns>The number of control entries to skip, or -1 if the run cannot resume.</returns>
+long startCheckpoints(char* fileName, char* resultsFileName, int resume)
+{
+    Checkpoint checkpoint;
+    long long length = resultsLength(resultsFileName);
+
+    if (!resume || !readCheckpoint(fileName, &checkpoint))
+    {
+        if (resume)
+        {
+            if (length > 0 && !truncateResults(resultsFileName, 0))
+            {
+                fprintf(stderr, "Cannot resume: could not truncate %s\n", resultsFileName);
+                return -1;
+            }
+            printf("No checkpoint %s, starting from the first test, %lli bytes of %s dropped\n", fileName,
+                length, resultsFileName);
+            length = 0;
+        }
+        saveCheckpoint(fileName, 0, length);
+        return 0;
+    }
+
+    // a results file shorter than its checkpoint has lost results the run would not write again
+    if (length < checkpoint.length)
+    {
+        fprintf(stderr, "Cannot resume: %s is %lli bytes, shorter than the %lli of checkpoint %s\n",
+            resultsFileName, length, checkpoint.length, fileName);
+        return -1;
+    }
+    if (length > checkpoint.length && !truncateResults(resultsFileName, checkpoint.length))
+    {
+        fprintf(stderr, "Cannot resume: could not truncate %s\n", resultsFileName);
+        return -1;
+    }
+
+    printf("Resuming after test %li, %lli bytes of %s dropped\n", checkpoint.tests - 1,
+        length - checkpoint.length, resultsFileName);
+    return checkpoint.tests;
+}
+
+#endif
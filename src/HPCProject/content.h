@@ -0,0 +1,157 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: content.h
+// Description: Content identity of the texts and patterns read by
+// project_OMP and project_MPI. Each file is hashed as it is loaded, and
+// files with the same contents share one buffer: a file identical to an
+// earlier one, or which is a prefix of a longer one, points into that
+// file's buffer and its own copy is freed.
+//
+// Every file is given a content ID, the number of the first file with
+// the same contents, so tests of files with the same contents can be
+// recognised as the same search. Files sharing a buffer because one is
+// a prefix of the other keep different IDs, since they are searched
+// differently, but the buffer of a file and of every file sharing it
+// start at the same address.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef CONTENT_H
+#define CONTENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTENT_HASH_BASIS 0xcbf29ce484222325ULL
+#define CONTENT_HASH_PRIME 0x100000001b3ULL
+
+/// <summary>
+/// Hashes the contents of a file with 64-bit FNV-1a.
+/// </summary>
+/// <param name="data">The contents.</param>
+/// <param name="length">The length of the contents.</param>
+/// <returns>The hash.</returns>
+unsigned long long hashContent(const char* data, int length)
+{
+    unsigned long long hash = CONTENT_HASH_BASIS;
+    int i;
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= CONTENT_HASH_PRIME;
+    }
+    return hash;
+}
+
+/// <summary>
+/// Shares one buffer between files with the same contents, and between a file and every file
+/// which is a prefix of it. Files are considered longest first, so each shares the buffer of
+/// the longest file holding its contents. The buffers no longer used are freed.
+/// </summary>
+/// <param name="name">The name of the files, for messages.</param>
+/// <param name="count">The number of files, where data[i] is NULL for a file not read.</param>
+/// <param name="data">The contents of each file, changed to the shared buffer.</param>
+/// <param name="lengths">The length of each file.</param>
+/// <param name="ids">Array to store the content ID of each file, -1 for a file not read.</param>
+/// <param name="owners">Array to store the file whose buffer each file shares, which is itself if
+/// it shares no other file's buffer. May be NULL.</param>
+/// <returns>The number of bytes no longer held.</returns>
+long shareContents(char* name, int count, char* data[], int lengths[], int ids[], int owners[])
+{
+    unsigned long long* hashes = (unsigned long long*)malloc((count + 1) * sizeof(unsigned long long));
+    int* order = (int*)malloc((count + 1) * sizeof(int));
+    int* owner = (int*)malloc((count + 1) * sizeof(int));
+    long saved = 0;
+    int i, j;
+
+    if (hashes == NULL || order == NULL || owner == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(0);
+    }
+
+    // longest first, and in file order between files of one length
+    for (i = 0; i < count; i++)
+    {
+        ids[i] = -1;
+        owner[i] = i;
+        hashes[i] = data[i] != NULL ? hashContent(data[i], lengths[i]) : 0;
+
+        for (j = i; j > 0 && lengths[order[j - 1]] < lengths[i]; j--)
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        int f = order[i];
+        if (data[f] == NULL)
+            continue;
+
+        // an identical file has the same hash, any earlier buffer long enough may hold a prefix
+        for (j = 0; j < i && owner[f] == f; j++)
+        {
+            int o = order[j];
+            if (data[o] == NULL || owner[o] != o || lengths[o] < lengths[f])
+                continue;
+            if (lengths[o] == lengths[f] && hashes[o] != hashes[f])
+                continue;
+            if (lengths[f] > 0 && memcmp(data[o], data[f], lengths[f]) != 0)
+                continue;
+            owner[f] = o;
+        }
+
+        if (owner[f] != f)
+        {
+            printf("%s %i shares the contents of %s %i\n", name, f, name, owner[f]);
+            free(data[f]);
+            data[f] = data[owner[f]];
+            saved += lengths[f];
+        }
+    }
+
+    // the ID of a file is the first file with the same contents
+    for (i = 0; i < count; i++)
+    {
+        if (owners != NULL)
+            owners[i] = owner[i];
+        if (data[i] == NULL)
+            continue;
+        for (j = 0; j <= i && ids[i] < 0; j++)
+        {
+            if (data[j] == data[i] && lengths[j] == lengths[i])
+                ids[i] = j;
+        }
+    }
+
+    free(hashes);
+    free(order);
+    free(owner);
+    return saved;
+}
+
+/// <summary>
+/// Frees the contents of files, freeing each buffer shared by shareContents once.
+/// </summary>
+/// <param name="count">The number of files, where data[i] is NULL for a file not read.</param>
+/// <param name="data">The contents of each file, set to NULL.</param>
+/// <param name="owners">The file whose buffer each file shares, from shareContents, or NULL if
+/// every file holds its own buffer.</param>
+void freeContents(int count, char* data[], const int owners[])
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        if (owners == NULL || owners[i] == i)
+            free(data[i]);
+    }
+    for (i = 0; i < count; i++)
+    {
+        data[i] = NULL;
+    }
+}
+
+#endif
@@ -0,0 +1,426 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: control.h
+// Description: Streaming reader of the control file, shared by
+// project_OMP and project_MPI. Entries are parsed one at a time from a
+// fixed buffer as the programs ask for them, so a control file of any
+// length is run in constant memory and the first test starts as soon
+// as its line is read.
+//
+// An entry is a line "mode text pattern [limit [start [end]]]". Numbers
+// are read as sscanf's %i reads them: decimal, or hexadecimal with 0x,
+// or octal with a leading 0. Lines with fewer than 3 numbers, and
+// entries naming a text or pattern number the programs cannot hold, are
+// skipped. start and end restrict the test to occurrences lying within
+// characters start to end - 1 of the text, whose locations are still
+// offsets in the whole text. end defaults to, and is cut to, the end of
+// the text, as is a negative end. limit is ignored by modes other than
+// 3, and a limit below 1 is read as 1, as the searches take it.
+//
+// Tests read together may be run in a different order, grouped by text
+// and then by pattern so each text is searched while it is in cache
+// (orderControl). Texts and patterns are grouped by content ID
+// (content.h), so a test of the same search as the test before it can
+// copy its results rather than search again (sameSearch, copyOutput). The results of each test are held in a TestOutput
+// and written in control order once every test read with it has run,
+// so the results file is the same whatever order the tests run in.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define CONTROL_BUFFER_SIZE 65536
+#define BYTES_PER_RESULT 40 // 3 numbers of at most 11 characters, 2 spaces and a newline
+#define CONTROL_VALUES 6 // numbers of the longest control entry
+
+typedef struct
+{
+    int mode;
+    int textNumber;
+    int patternNumber;
+    int limit; // number of occurrences requested by search mode 3
+    int start; // the range of the text searched, end -1 for the end of the text
+    int end;
+} ControlEntry;
+
+typedef struct
+{
+    FILE* f;
+    char buffer[CONTROL_BUFFER_SIZE];
+    int start;
+    int end;
+    int eof;
+    int maxTexts; // entries must name a text below maxTexts and a pattern below maxPatterns
+    int maxPatterns;
+    long entries; // entries read so far
+} ControlReader;
+
+// the result lines of a test, kept and reused by later tests once written
+typedef struct
+{
+    char* data;
+    int length;
+    int allocated;
+} TestOutput;
+
+/// <summary>
+/// Opens the control file in a directory.
+/// </summary>
+/// <param name="reader">The reader to open.</param>
+/// <param name="directory">The directory holding control.txt.</param>
+/// <param name="maxTexts">The number of texts the program holds.</param>
+/// <param name="maxPatterns">The number of patterns the program holds.</param>
+/// <returns>1 if the file was opened, otherwise 0, in which case the reader returns no entries.</returns>
+int openControl(ControlReader* reader, char* directory, int maxTexts, int maxPatterns)
+{
+    char fileName[1000];
+
+#ifdef DOS
+    sprintf(fileName, "%s\\control.txt", directory);
+#else
+    sprintf(fileName, "%s/control.txt", directory);
+#endif
+
+    reader->f = fopen(fileName, "r");
+    reader->start = reader->end = 0;
+    reader->eof = reader->f == NULL;
+    reader->maxTexts = maxTexts;
+    reader->maxPatterns = maxPatterns;
+    reader->entries = 0;
+    return reader->f != NULL;
+}
+
+/// <summary>
+/// Closes the control file.
+/// </summary>
+void closeControl(ControlReader* reader)
+{
+    if (reader->f != NULL)
+        fclose(reader->f);
+    reader->f = NULL;
+    reader->eof = 1;
+}
+
+/// <summary>
+/// Parses a number of a control entry as %i does.
+/// </summary>
+/// <param name="p">The position to parse from, moved past the number.</param>
+/// <param name="end">The end of the line.</param>
+/// <param name="value">Set to the number, clamped to the range of an int.</param>
+/// <returns>1 if a number was parsed, otherwise 0.</returns>
+int parseControlNumber(const char** p, const char* end, int* value)
+{
+    const char* s = *p;
+    int negative = 0;
+    int base = 10;
+    long long result = 0;
+
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    if (s < end && *s == '0')
+    {
+        base = 8;
+        if (s + 2 < end && (s[1] == 'x' || s[1] == 'X') &&
+            ((s[2] >= '0' && s[2] <= '9') || (s[2] >= 'a' && s[2] <= 'f') || (s[2] >= 'A' && s[2] <= 'F')))
+        {
+            base = 16;
+            s += 2;
+        }
+    }
+
+    const char* digits = s;
+    while (s < end)
+    {
+        int digit;
+        if (*s >= '0' && *s <= '9')
+            digit = *s - '0';
+        else if (base == 16 && *s >= 'a' && *s <= 'f')
+            digit = *s - 'a' + 10;
+        else if (base == 16 && *s >= 'A' && *s <= 'F')
+            digit = *s - 'A' + 10;
+        else
+            break;
+        if (digit >= base)
+            break;
+
+        if (result <= INT_MAX)
+            result = result * base + digit;
+        s++;
+    }
+    if (s == digits)
+        return 0;
+
+    if (result > INT_MAX)
+        result = INT_MAX;
+    *value = (int)(negative ? -result : result);
+    *p = s;
+    return 1;
+}
+
+/// <summary>
+/// Parses the numbers of a control line.
+/// </summary>
+/// <param name="line">The start of the line.</param>
+/// <param name="end">The end of the line.</param>
+/// <param name="values">Array to store up to CONTROL_VALUES numbers.</param>
+/// <returns>The number of numbers parsed, or -1 if the line is blank, as sscanf returns.</returns>
+int parseControlLine(const char* line, const char* end, int values[CONTROL_VALUES])
+{
+    int count = 0;
+    while (count < CONTROL_VALUES)
+    {
+        while (line < end && (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\v' || *line == '\f'))
+        {
+            line++;
+        }
+        if (line == end)
+            return count == 0 ? -1 : count;
+        if (!parseControlNumber(&line, end, &values[count]))
+            break;
+        count++;
+    }
+    return count;
+}
+
+/// <summary>
+/// Gets the next line of the control file, reading more of the file when needed.
+/// </summary>
+/// <param name="reader">The reader.</param>
+/// <param name="end">Set to the end of the line.</param>
+/// <returns>The start of the line, valid until the next line is read, or NULL at the end of the file.</returns>
+char* nextControlLine(ControlReader* reader, char** end)
+{
+    while (1)
+    {
+        char* start = reader->buffer + reader->start;
+        char* newline = (char*)memchr(start, '\n', reader->end - reader->start);
+        if (newline != NULL)
+        {
+            reader->start = (int)(newline - reader->buffer) + 1;
+            *end = newline;
+            return start;
+        }
+
+        if (reader->eof)
+        {
+            // a final line without a newline
+            if (reader->start == reader->end)
+                return NULL;
+            *end = reader->buffer + reader->end;
+            reader->start = reader->end;
+            return start;
+        }
+
+        // keep the partial line and fill the rest of the buffer, dropping lines too long to ever fit
+        memmove(reader->buffer, start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if (reader->end == CONTROL_BUFFER_SIZE)
+            reader->end = 0;
+
+        size_t count = fread(reader->buffer + reader->end, 1, CONTROL_BUFFER_SIZE - reader->end, reader->f);
+        reader->end += (int)count;
+        if (count == 0)
+            reader->eof = 1;
+    }
+}
+
+/// <summary>
+/// Reads the next entry of the control file.
+/// </summary>
+/// <param name="reader">The reader.</param>
+/// <param name="entry">The entry to fill in.</param>
+/// <returns>1 if an entry was read, 0 at the end of the file.</returns>
+int nextControlEntry(ControlReader* reader, ControlEntry* entry)
+{
+    char* end;
+    char* line;
+    int values[CONTROL_VALUES];
+
+    while ((line = nextControlLine(reader, &end)) != NULL)
+    {
+        int readResult = parseControlLine(line, end, values);
+        if (readResult >= 3)
+        {
+            if (values[1] < 0 || values[1] >= reader->maxTexts || values[2] < 0 || values[2] >= reader->maxPatterns)
+            {
+                printf("Skipping control entry with unknown text or pattern %.*s\n", (int)(end - line), line);
+                continue;
+            }
+
+            entry->mode = values[0];
+            entry->textNumber = values[1];
+            entry->patternNumber = values[2];
+            entry->limit = readResult >= 4 && values[3] > 1 ? values[3] : 1;
+            entry->start = readResult >= 5 && values[4] > 0 ? values[4] : 0;
+            entry->end = readResult >= 6 && values[5] >= 0 ? values[5] : -1;
+            reader->entries++;
+            return 1;
+        }
+        else if (readResult > 0)
+        {
+            printf("Skipping incomplete control entry %.*s\n", (int)(end - line), line);
+        }
+    }
+    return 0;
+}
+
+/// <summary>
+/// Skips entries of the control file, such as those a resumed run has already written the results
+/// of, without the messages of nextControlEntry.
+/// </summary>
+/// <param name="reader">The reader.</param>
+/// <param name="count">The number of entries to skip.</param>
+/// <returns>The number of entries skipped, fewer than count if the file ended.</returns>
+long skipControlEntries(ControlReader* reader, long count)
+{
+    char* end;
+    char* line;
+    int values[CONTROL_VALUES];
+    long skipped = 0;
+
+    while (skipped < count && (line = nextControlLine(reader, &end)) != NULL)
+    {
+        if (parseControlLine(line, end, values) < 3)
+            continue;
+        if (values[1] < 0 || values[1] >= reader->maxTexts || values[2] < 0 || values[2] >= reader->maxPatterns)
+            continue;
+
+        reader->entries++;
+        skipped++;
+    }
+    return skipped;
+}
+
+/// <summary>
+/// Gets the range of a text a test searches.
+/// </summary>
+/// <param name="entry">The control entry of the test.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="start">Set to the first character searched.</param>
+/// <param name="end">Set to one past the last character searched, at least start.</param>
+void controlRange(const ControlEntry* entry, int textLength, int* start, int* end)
+{
+    *end = entry->end < 0 || entry->end > textLength ? textLength : entry->end;
+    *start = entry->start < *end ? entry->start : *end;
+}
+
+/// <summary>
+/// Orders tests so that tests of the same text, and then of the same pattern, run one after
+/// another, where texts and patterns with the same contents are the same. Tests keep their
+/// control order within a group.
+/// </summary>
+/// <param name="entries">The control entries of the tests.</param>
+/// <param name="count">The number of tests.</param>
+/// <param name="textIds">The content ID of each text.</param>
+/// <param name="patternIds">The content ID of each pattern.</param>
+/// <param name="order">Array to store the order to run the tests in, as indexes into entries.</param>
+void orderControl(ControlEntry entries[], int count, const int textIds[], const int patternIds[], int order[])
+{
+    int i, j;
+    for (i = 0; i < count; i++)
+    {
+        int text = textIds[entries[i].textNumber];
+        int pattern = patternIds[entries[i].patternNumber];
+        for (j = i; j > 0; j--)
+        {
+            ControlEntry* previous = &entries[order[j - 1]];
+            int previousText = textIds[previous->textNumber];
+            if (previousText < text || (previousText == text && patternIds[previous->patternNumber] <= pattern))
+                break;
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+}
+
+/// <summary>
+/// Checks whether two tests are the same search: the same mode, limit and range, of texts with the
+/// same contents for patterns with the same contents.
+/// </summary>
+/// <returns>1 if the tests have the same results, other than their text and pattern numbers.</returns>
+int sameSearch(const ControlEntry* a, const ControlEntry* b, const int textIds[], const int patternIds[])
+{
+    return a->mode == b->mode && (a->mode != 3 || a->limit == b->limit) &&
+        a->start == b->start && a->end == b->end &&
+        textIds[a->textNumber] == textIds[b->textNumber] &&
+        patternIds[a->patternNumber] == patternIds[b->patternNumber];
+}
+
+/// <summary>
+/// Appends a result line to the output of a test.
+/// </summary>
+/// <param name="output">The output of the test.</param>
+/// <param name="textNumber">The text number of the test.</param>
+/// <param name="patternNumber">The pattern number of the test.</param>
+/// <param name="value">The location, count or status of the result.</param>
+void appendOutput(TestOutput* output, int textNumber, int patternNumber, int value)
+{
+    if (output->length + BYTES_PER_RESULT >= output->allocated)
+    {
+        output->allocated = output->allocated ? output->allocated * 2 : 256;
+        output->data = (char*)realloc(output->data, output->allocated);
+        if (output->data == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(0);
+        }
+    }
+    output->length += sprintf(output->data + output->length, "%i %i %i\n", textNumber, patternNumber, value);
+}
+
+/// <summary>
+/// Copies the results of a test to the output of a test of the same search, renumbered with the
+/// text and pattern numbers of that test.
+/// </summary>
+/// <param name="output">The output of the test.</param>
+/// <param name="source">The output of the test of the same search.</param>
+/// <param name="textNumber">The text number of the test.</param>
+/// <param name="patternNumber">The pattern number of the test.</param>
+void copyOutput(TestOutput* output, const TestOutput* source, int textNumber, int patternNumber)
+{
+    const char* line = source->data;
+    const char* end = source->data + source->length;
+    while (line < end)
+    {
+        // the value follows the text and pattern numbers
+        const char* value = (const char*)memchr(line, ' ', end - line) + 1;
+        value = (const char*)memchr(value, ' ', end - value) + 1;
+        const char* newline = (const char*)memchr(value, '\n', end - value);
+        appendOutput(output, textNumber, patternNumber, atoi(value));
+        line = newline + 1;
+    }
+}
+
+/// <summary>
+/// Appends the outputs of tests to the results file in the order given, and empties them.
+/// </summary>
+/// <param name="fileName">The results file.</param>
+/// <param name="outputs">The outputs of the tests, in control order.</param>
+/// <param name="count">The number of tests.</param>
+void writeOutputs(char* fileName, TestOutput outputs[], int count)
+{
+    int t;
+    FILE* f = fopen(fileName, "a+");
+    if (f == NULL)
+        fprintf(stderr, "writeOutputs: could not open file %s", fileName);
+
+    for (t = 0; t < count; t++)
+    {
+        if (f != NULL)
+            fwrite(outputs[t].data, 1, outputs[t].length, f);
+        outputs[t].length = 0;
+    }
+
+    if (f != NULL)
+        fclose(f);
+}
+
+#endif
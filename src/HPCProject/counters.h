@@ -0,0 +1,150 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: counters.h
+// Description: Hardware performance counters of a thread, read with
+// perf_event_open around each search by project_OMP and project_MPI.
+// Each thread or process opens its own counters, which count only that
+// thread in user mode, and the difference of two reads is the work of
+// the search between them.
+//
+// Counted events:
+//      cycles              CPU cycles
+//      instructions        instructions retired
+//      llc_misses          last level cache misses
+//      branch_misses       mispredicted branches
+//
+// An event the CPU, kernel or permissions do not allow, such as in a
+// virtual machine or with kernel.perf_event_paranoid above 2, reads as
+// -1 and is left empty in the run report. Outside Linux no event is
+// available.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_LLC_MISSES 2
+#define COUNTER_BRANCH_MISSES 3
+#define COUNTER_EVENTS 4
+
+// the counters of one thread
+typedef struct
+{
+    int fds[COUNTER_EVENTS]; // -1 for an event not available
+} Counters;
+
+/// <summary>
+/// Opens the counters of the calling thread, which count from now until they are closed. Prints
+/// why the first unavailable event could not be opened, once per process.
+/// </summary>
+/// <param name="counters">The counters to open.</param>
+/// <returns>The number of events available.</returns>
+int openCounters(Counters* counters)
+{
+    int available = 0;
+    int e;
+
+#ifdef __linux__
+    static int reported = 0;
+    static const unsigned long long events[COUNTER_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (e = 0; e < COUNTER_EVENTS; e++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[e];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        counters->fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counters->fds[e] >= 0)
+            available++;
+        else if (!reported)
+        {
+            #pragma omp critical
+            {
+                if (!reported)
+                    printf("Hardware counter %i unavailable: %s\n", e, strerror(errno));
+                reported = 1;
+            }
+        }
+    }
+#else
+    for (e = 0; e < COUNTER_EVENTS; e++)
+    {
+        counters->fds[e] = -1;
+    }
+#endif
+    return available;
+}
+
+/// <summary>
+/// Reads the counters of the calling thread.
+/// </summary>
+/// <param name="counters">The counters, opened by the calling thread.</param>
+/// <param name="values">Array to store the count of each event, -1 for an event not available.</param>
+void readCounters(Counters* counters, long long values[COUNTER_EVENTS])
+{
+    int e;
+    for (e = 0; e < COUNTER_EVENTS; e++)
+    {
+        values[e] = -1;
+#ifdef __linux__
+        long long value;
+        if (counters->fds[e] >= 0 && read(counters->fds[e], &value, sizeof(value)) == sizeof(value))
+            values[e] = value;
+#endif
+    }
+}
+
+/// <summary>
+/// Closes the counters of a thread.
+/// </summary>
+void closeCounters(Counters* counters)
+{
+    int e;
+    for (e = 0; e < COUNTER_EVENTS; e++)
+    {
+#ifdef __linux__
+        if (counters->fds[e] >= 0)
+            close(counters->fds[e]);
+#endif
+        counters->fds[e] = -1;
+    }
+}
+
+/// <summary>
+/// Adds the counts between two reads to a total, which becomes -1 if any count is not available.
+/// </summary>
+/// <param name="total">The total of each event.</param>
+/// <param name="start">The counts read before the search.</param>
+/// <param name="end">The counts read after the search.</param>
+void addCounters(long long total[COUNTER_EVENTS], const long long start[COUNTER_EVENTS], const long long end[COUNTER_EVENTS])
+{
+    int e;
+    for (e = 0; e < COUNTER_EVENTS; e++)
+    {
+        if (total[e] < 0 || start[e] < 0 || end[e] < 0)
+            total[e] = -1;
+        else
+            total[e] += end[e] - start[e];
+    }
+}
+
+#endif
@@ -0,0 +1,233 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: generate_inputs
+// Description: Writes a synthetic input directory in the same layout
+// as small-inputs (textN.txt, patternN.txt and control.txt) so that the
+// search programs can be measured on inputs of a controlled size.
+//
+// Usage: generate_inputs <directory> [options]
+//      -texts n        number of texts to write (default 4)
+//      -size n         characters per text (default 1048576)
+//      -patterns n     number of patterns to write (default 4)
+//      -length n       characters per pattern (default 8)
+//      -alphabet n     number of symbols in random texts (default 4)
+//      -density d      planted matches per million characters (default 1)
+//      -adversarial n  every nth text uses runs of A broken by B like text0,
+//                      and every nth pattern is AAA..AB (default 0, off)
+//      -modes n        search modes 0 to n-1 are requested (default 2)
+//      -seed n         random seed (default 1)
+//
+// The directory must already exist. Each pattern is planted in every
+// random text, and the control file asks for every text and pattern
+// combination using each of the requested search modes.
+//
+/////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "synthetic.h"
+
+#define MAX_TEXTS 20
+#define MAX_PATTERNS 20 // the search programs read at most 20 of each
+
+/// <summary>
+/// Writes a block of characters to the file directory/name.
+/// </summary>
+/// <param name="directory">The directory to write the file to.</param>
+/// <param name="name">The name of the file.</param>
+/// <param name="data">The characters to write.</param>
+/// <param name="length">The number of characters to write.</param>
+/// <returns>1 if the file was written, otherwise 0.</returns>
+int writeFile(char* directory, char* name, char* data, long length)
+{
+    FILE* f;
+    char fileName[1000];
+
+#ifdef DOS
+    sprintf(fileName, "%s\\%s", directory, name);
+#else
+    sprintf(fileName, "%s/%s", directory, name);
+#endif
+
+    f = fopen(fileName, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "writeFile: could not open file %s\n", fileName);
+        return 0;
+    }
+    fwrite(data, sizeof(char), length, f);
+    fclose(f);
+    return 1;
+}
+
+/// <summary>
+/// Reads the value following an option, exiting if it is missing.
+/// </summary>
+/// <param name="argc">The number of arguments.</param>
+/// <param name="argv">The arguments.</param>
+/// <param name="i">The index of the option.</param>
+/// <returns>The value of the option.</returns>
+char* optionValue(int argc, char** argv, int i)
+{
+    if (i + 1 >= argc)
+    {
+        fprintf(stderr, "Missing value for option %s\n", argv[i]);
+        exit(1);
+    }
+    return argv[i + 1];
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("Not enough arguments: No output directory provided.\n");
+        exit(1);
+    }
+    char* directory = argv[1];
+
+    int textCount = 4;
+    long textSize = 1048576;
+    int patternCount = 4;
+    int patternLength = 8;
+    int alphabet = 4;
+    double density = 1.0;
+    int adversarial = 0;
+    int modes = 2;
+    unsigned long long seed = 1;
+
+    int i;
+    for (i = 2; i < argc; i += 2)
+    {
+        char* value = optionValue(argc, argv, i);
+        if (strcmp(argv[i], "-texts") == 0)
+            textCount = atoi(value);
+        else if (strcmp(argv[i], "-size") == 0)
+            textSize = atol(value);
+        else if (strcmp(argv[i], "-patterns") == 0)
+            patternCount = atoi(value);
+        else if (strcmp(argv[i], "-length") == 0)
+            patternLength = atoi(value);
+        else if (strcmp(argv[i], "-alphabet") == 0)
+            alphabet = atoi(value);
+        else if (strcmp(argv[i], "-density") == 0)
+            density = atof(value);
+        else if (strcmp(argv[i], "-adversarial") == 0)
+            adversarial = atoi(value);
+        else if (strcmp(argv[i], "-modes") == 0)
+            modes = atoi(value);
+        else if (strcmp(argv[i], "-seed") == 0)
+            seed = strtoull(value, NULL, 10);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (textCount < 1 || textCount > MAX_TEXTS || patternCount < 1 || patternCount > MAX_PATTERNS)
+    {
+        fprintf(stderr, "Between 1 and %i texts and patterns may be generated.\n", MAX_TEXTS);
+        exit(1);
+    }
+    if (textSize < 1 || patternLength < 1)
+    {
+        fprintf(stderr, "Text size and pattern length must be positive.\n");
+        exit(1);
+    }
+
+    seedSynthetic(seed);
+
+    char name[100];
+    char* text = (char*)malloc(textSize * sizeof(char));
+    char** patterns = (char**)malloc(patternCount * sizeof(char*));
+    if (text == NULL || patterns == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    // patterns are generated first so they can be planted in the texts
+    for (i = 0; i < patternCount; i++)
+    {
+        patterns[i] = (char*)malloc(patternLength * sizeof(char));
+        if (patterns[i] == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+        if (adversarial > 0 && i % adversarial == 0)
+            fillAdversarialPattern(patterns[i], patternLength, 'B');
+        else
+            fillRandomText(patterns[i], patternLength, alphabet);
+
+        sprintf(name, "pattern%i.txt", i);
+        if (!writeFile(directory, name, patterns[i], patternLength))
+            exit(1);
+    }
+
+    for (i = 0; i < textCount; i++)
+    {
+        if (adversarial > 0 && i % adversarial == 0)
+        {
+            // run length is one longer than the pattern so that each AAA..AB pattern
+            // mismatches on its final character everywhere except at the B
+            fillAdversarialText(text, textSize, patternLength + 1);
+        }
+        else
+        {
+            fillRandomText(text, textSize, alphabet);
+
+            int p;
+            for (p = 0; p < patternCount; p++)
+            {
+                plantMatches(text, textSize, patterns[p], patternLength, density);
+            }
+        }
+
+        sprintf(name, "text%i.txt", i);
+        if (!writeFile(directory, name, text, textSize))
+            exit(1);
+        printf("wrote %s\n", name);
+    }
+
+    // request every combination using each search mode
+    FILE* control;
+    char fileName[1000];
+#ifdef DOS
+    sprintf(fileName, "%s\\control.txt", directory);
+#else
+    sprintf(fileName, "%s/control.txt", directory);
+#endif
+    control = fopen(fileName, "w");
+    if (control == NULL)
+    {
+        fprintf(stderr, "Could not open file %s\n", fileName);
+        exit(1);
+    }
+
+    int t, p, mode;
+    for (t = 0; t < textCount; t++)
+    {
+        for (p = 0; p < patternCount; p++)
+        {
+            for (mode = 0; mode < modes; mode++)
+            {
+                fprintf(control, "%i %i %i\n", mode, t, p);
+            }
+        }
+    }
+    fclose(control);
+
+    for (i = 0; i < patternCount; i++)
+    {
+        free(patterns[i]);
+    }
+    free(patterns);
+    free(text);
+
+    return 0;
+}
@@ -5,13 +5,17 @@
 #SBATCH --ntasks=1
 #SBTACH --cpus-per-task=4
 
-gcc -fopenmp project_OMP.c -o execute_OMP -std=c11 -w -O2
+gcc -fopenmp -c search.c -o search.o -std=c11 -w -O2
+ar rcs libsearch.a search.o
+gcc -fopenmp project_OMP.c libsearch.a -o execute_OMP -std=c11 -w -O2
 
 export OMP_NUM_THREADS=4
 
 echo "Start Open MP Project"
 
-time ./execute_OMP large-inputs
+# a job stopped by the walltime continues from its last checkpoint when resubmitted, and the
+# first submission starts with an empty result_OMP.txt. Remove checkpoint_OMP.txt to run again
+time ./execute_OMP large-inputs -checkpoint 64 -resume
 
 echo "Finished Open MP Project"
 
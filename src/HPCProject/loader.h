@@ -0,0 +1,401 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: loader.h
+// Description: Loading of the texts and patterns of project_OMP and
+// project_MPI as the tests need them, rather than every file before the
+// first test.
+//
+// With prefetching, a loader thread reads the control file on its own
+// and reads each text and pattern the first time an entry names it, so
+// files are read in the order the tests need them while the tests run
+// on those already read. A test waits only for its own text and pattern,
+// so the first test starts once its two files are read rather than once
+// every file is.
+//
+// With lazy loading, the control file is read once before the tests to
+// count the entries naming each file, and only files which are named
+// are read: on the thread of the test which first needs one, or ahead of
+// the tests by the loader thread when prefetching too. Each test
+// releases its text and pattern once it has run, and a file is freed
+// once the last test naming it has released it, so the memory held
+// follows the files the tests are using. The loader thread then reads
+// at most LOADER_AHEAD texts ahead of the tests releasing them, unless a
+// test is waiting.
+//
+// Otherwise every file is read, those named by the control file first.
+// Entries a resumed run skips (checkpoint.h) are not counted or read
+// ahead for.
+// A file which is missing is left empty.
+//
+// DOS builds have no threads, and prefetch nothing, as does a program
+// which cannot start a thread.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef DOS
+#include <pthread.h>
+#endif
+
+#include "control.h"
+
+#define MAX_LOADED 64
+
+// texts read and not yet released which the loader thread reads ahead of the tests in lazy loading
+#define LOADER_AHEAD 2
+
+// the files of one kind, texts or patterns, and which of them have been read
+typedef struct
+{
+    char* name; // "text" or "pattern"
+    int max; // the number of files the program holds
+    char** data; // arrays of the program, filled in as files are read
+    int* lengths;
+    long* loadNanos;
+    char loaded[MAX_LOADED]; // whether the file has been read, or found missing
+    int refs[MAX_LOADED]; // tests naming the file which have not released it, in lazy loading
+} LoadedFiles;
+
+typedef struct
+{
+    char* directory;
+    LoadedFiles texts;
+    LoadedFiles patterns;
+    void (*readFile)(FILE* f, char** data, int* length); // reads the contents of an open file
+
+    // set before the loader is started
+    int printReads; // whether each file read and released is printed
+    int prefetch; // whether files are read ahead of the tests by a thread
+    int lazy; // whether only files named by the control file are read, and released after their last test
+    long skip; // entries at the start of the control file which are not run, as in a resumed run
+
+    int threaded; // whether the loader thread is running
+    int resident; // texts read and not yet released
+    int waiting; // tests waiting for a file
+#ifndef DOS
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // signalled whenever a file is read or released, or a test waits
+#endif
+} Loader;
+
+/// <summary>
+/// Gets the current time in nanoseconds.
+/// </summary>
+/// <returns>The time in nanoseconds.</returns>
+long loaderNanos()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/// <summary>
+/// Locks the state of the loader shared with the loader thread.
+/// </summary>
+void lockLoader(Loader* loader)
+{
+#ifndef DOS
+    pthread_mutex_lock(&loader->lock);
+#endif
+}
+
+/// <summary>
+/// Unlocks the state of the loader, waking every thread waiting for it to change if it changed.
+/// </summary>
+/// <param name="loader">The loader.</param>
+/// <param name="changed">Whether the state changed.</param>
+void unlockLoader(Loader* loader, int changed)
+{
+#ifndef DOS
+    if (changed)
+        pthread_cond_broadcast(&loader->changed);
+    pthread_mutex_unlock(&loader->lock);
+#endif
+}
+
+/// <summary>
+/// Reads the next entry of the control file naming a text and pattern the program holds, without
+/// the messages of nextControlEntry, which the tests print.
+/// </summary>
+/// <param name="loader">The loader.</param>
+/// <param name="control">The control file.</param>
+/// <param name="text">Set to the text number of the entry.</param>
+/// <param name="pattern">Set to the pattern number of the entry.</param>
+/// <returns>1 if an entry was read, 0 at the end of the file.</returns>
+int nextNamedFiles(Loader* loader, ControlReader* control, int* text, int* pattern)
+{
+    char* line;
+    char* end;
+    int values[CONTROL_VALUES];
+
+    while ((line = nextControlLine(control, &end)) != NULL)
+    {
+        if (parseControlLine(line, end, values) < 3)
+            continue;
+        if (values[1] < 0 || values[1] >= loader->texts.max || values[2] < 0 || values[2] >= loader->patterns.max)
+            continue;
+
+        *text = values[1];
+        *pattern = values[2];
+        return 1;
+    }
+    return 0;
+}
+
+/// <summary>
+/// Reads a file unless it has been read, and wakes the tests waiting for it. Called by the loader
+/// thread, or by a test when there is none.
+/// </summary>
+/// <param name="loader">The loader.</param>
+/// <param name="files">The files of the kind.</param>
+/// <param name="number">The number of the file.</param>
+void loadFile(Loader* loader, LoadedFiles* files, int number)
+{
+    char fileName[1000];
+    char* data = NULL;
+    int length = 0;
+
+    if (number < 0 || number >= files->max)
+        return;
+
+    // only one thread reads files, so a file is never read twice
+    lockLoader(loader);
+    int loaded = files->loaded[number];
+
+#ifndef DOS
+    // reading ahead of the tests stops while enough texts are held, unless a test is waiting
+    while (!loaded && loader->threaded && loader->lazy && files == &loader->texts &&
+        loader->resident >= LOADER_AHEAD && loader->waiting == 0)
+    {
+        pthread_cond_wait(&loader->changed, &loader->lock);
+    }
+#endif
+    unlockLoader(loader, 0);
+    if (loaded)
+        return;
+
+    long time = loaderNanos();
+#ifdef DOS
+    sprintf(fileName, "%s\\%s%i.txt", loader->directory, files->name, number);
+#else
+    sprintf(fileName, "%s/%s%i.txt", loader->directory, files->name, number);
+#endif
+    FILE* f = fopen(fileName, "r");
+    if (f != NULL)
+    {
+        loader->readFile(f, &data, &length);
+        fclose(f);
+        if (loader->printReads)
+            printf("read %s %i\n", files->name, number);
+    }
+    time = loaderNanos() - time;
+
+    lockLoader(loader);
+    files->data[number] = data;
+    files->lengths[number] = length;
+    files->loadNanos[number] = time;
+    files->loaded[number] = 1;
+    if (data != NULL && files == &loader->texts)
+        loader->resident++;
+    unlockLoader(loader, 1);
+}
+
+/// <summary>
+/// Reads the files in the order the control file names them, and then every other file unless
+/// loading lazily.
+/// </summary>
+/// <param name="state">The loader.</param>
+/// <returns>NULL.</returns>
+void* runLoader(void* state)
+{
+    Loader* loader = (Loader*)state;
+    ControlReader* control = (ControlReader*)malloc(sizeof(ControlReader));
+    int text, pattern;
+    int i;
+
+    if (control != NULL && openControl(control, loader->directory, loader->texts.max, loader->patterns.max))
+    {
+        skipControlEntries(control, loader->skip);
+        while (nextNamedFiles(loader, control, &text, &pattern))
+        {
+            loadFile(loader, &loader->texts, text);
+            loadFile(loader, &loader->patterns, pattern);
+        }
+        closeControl(control);
+    }
+    free(control);
+
+    for (i = 0; i < MAX_LOADED && !loader->lazy; i++)
+    {
+        loadFile(loader, &loader->texts, i);
+        loadFile(loader, &loader->patterns, i);
+    }
+    return NULL;
+}
+
+/// <summary>
+/// Counts the entries of the control file naming each file.
+/// </summary>
+/// <param name="loader">The loader.</param>
+void countReferences(Loader* loader)
+{
+    ControlReader* control = (ControlReader*)malloc(sizeof(ControlReader));
+    int text, pattern;
+
+    if (control != NULL && openControl(control, loader->directory, loader->texts.max, loader->patterns.max))
+    {
+        skipControlEntries(control, loader->skip);
+        while (nextNamedFiles(loader, control, &text, &pattern))
+        {
+            loader->texts.refs[text]++;
+            loader->patterns.refs[pattern]++;
+        }
+        closeControl(control);
+    }
+    free(control);
+}
+
+/// <summary>
+/// Starts loading the texts and patterns of a directory into the arrays of a program, which are
+/// filled in as the files are read.
+/// </summary>
+/// <param name="loader">The loader to start, with printReads, prefetch, lazy and skip set.</param>
+/// <param name="directory">The directory to read from.</param>
+/// <param name="maxTexts">The number of texts the program holds.</param>
+/// <param name="textData">Array to store the contents of each text.</param>
+/// <param name="textLengths">Array to store the length of each text.</param>
+/// <param name="textLoadNanos">Array to store the time taken to read each text.</param>
+/// <param name="maxPatterns">The number of patterns the program holds.</param>
+/// <param name="patternData">Array to store the contents of each pattern.</param>
+/// <param name="patternLengths">Array to store the length of each pattern.</param>
+/// <param name="patternLoadNanos">Array to store the time taken to read each pattern.</param>
+/// <param name="readFile">Reads the contents of an open file.</param>
+void startLoader(Loader* loader, char* directory,
+    int maxTexts, char* textData[], int textLengths[], long textLoadNanos[],
+    int maxPatterns, char* patternData[], int patternLengths[], long patternLoadNanos[],
+    void (*readFile)(FILE* f, char** data, int* length))
+{
+    LoadedFiles texts = { "text", maxTexts < MAX_LOADED ? maxTexts : MAX_LOADED, textData, textLengths, textLoadNanos };
+    LoadedFiles patterns = { "pattern", maxPatterns < MAX_LOADED ? maxPatterns : MAX_LOADED, patternData, patternLengths, patternLoadNanos };
+
+    loader->directory = directory;
+    loader->texts = texts;
+    loader->patterns = patterns;
+    loader->readFile = readFile;
+    loader->threaded = 0;
+    loader->resident = 0;
+    loader->waiting = 0;
+
+    if (loader->lazy)
+        countReferences(loader);
+
+#ifndef DOS
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->changed, NULL);
+    if (loader->prefetch)
+        loader->threaded = pthread_create(&loader->thread, NULL, runLoader, loader) == 0;
+#endif
+
+    // without a thread, lazy loading reads each file when a test first needs it and otherwise
+    // every file is read now
+    if (!loader->threaded && !loader->lazy)
+        runLoader(loader);
+}
+
+/// <summary>
+/// Checks whether a file has been read, without waiting for it.
+/// </summary>
+/// <param name="loader">The loader.</param>
+/// <param name="files">The files of the kind.</param>
+/// <param name="number">The number of the file.</param>
+/// <returns>1 if the file has been read or is missing, otherwise 0.</returns>
+int fileLoaded(Loader* loader, LoadedFiles* files, int number)
+{
+    lockLoader(loader);
+    int loaded = files->loaded[number];
+    unlockLoader(loader, 0);
+    return loaded;
+}
+
+/// <summary>
+/// Waits until a file has been read, reading it if there is no loader thread, after which its
+/// contents may be used.
+/// </summary>
+/// <param name="loader">The loader.</param>
+/// <param name="files">The files of the kind.</param>
+/// <param name="number">The number of the file.</param>
+/// <returns>The time spent waiting in nanoseconds.</returns>
+long waitForFile(Loader* loader, LoadedFiles* files, int number)
+{
+    long time = loaderNanos();
+    if (!loader->threaded)
+    {
+        loadFile(loader, files, number);
+        return loaderNanos() - time;
+    }
+
+#ifndef DOS
+    pthread_mutex_lock(&loader->lock);
+    loader->waiting++;
+    pthread_cond_broadcast(&loader->changed);
+    while (!files->loaded[number])
+    {
+        pthread_cond_wait(&loader->changed, &loader->lock);
+    }
+    loader->waiting--;
+    pthread_mutex_unlock(&loader->lock);
+#endif
+    return loaderNanos() - time;
+}
+
+/// <summary>
+/// Releases a file used by a test which has run, freeing it once every test naming it has run.
+/// Only used in lazy loading.
+/// </summary>
+/// <param name="loader">The loader.</param>
+/// <param name="files">The files of the kind.</param>
+/// <param name="number">The number of the file.</param>
+/// <returns>The number of bytes freed.</returns>
+long releaseFile(Loader* loader, LoadedFiles* files, int number)
+{
+    long freed = 0;
+
+    lockLoader(loader);
+    if (--files->refs[number] == 0 && files->data[number] != NULL)
+    {
+        free(files->data[number]);
+        files->data[number] = NULL;
+        freed = files->lengths[number];
+        if (files == &loader->texts)
+            loader->resident--;
+    }
+    unlockLoader(loader, freed > 0);
+
+    if (freed > 0 && loader->printReads)
+        printf("released %s %i\n", files->name, number);
+    return freed;
+}
+
+/// <summary>
+/// Waits until the loader thread has read every file it will read, and stops the loader.
+/// </summary>
+/// <param name="loader">The loader.</param>
+void stopLoader(Loader* loader)
+{
+#ifndef DOS
+    if (loader->threaded)
+        pthread_join(loader->thread, NULL);
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->changed);
+#endif
+}
+
+#endif
@@ -0,0 +1,160 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: metrics.h
+// Description: Per test instrumentation shared by project_OMP and
+// project_MPI. Each program fills in a TestMetrics record while a
+// test runs and appends it to a CSV run report (metrics_OMP.csv or
+// metrics_MPI.csv) written next to the results file.
+//
+// Report columns:
+//      test, mode, text, pattern       the control entry
+//      text_length, pattern_length     sizes of the text and pattern
+//      load_seconds                    time spent reading the text and pattern files,
+//                                      plus time distributing the slices in MPI
+//      search_seconds                  wall time of the search
+//      bytes_scanned                   text positions a comparison was started from
+//      comparisons                     character comparisons made
+//      matches                         occurrences found (1 for search mode 0)
+//      workers                         threads or ranks used
+//      busy_min_seconds, busy_max_seconds
+//                                      least and most busy worker
+//      imbalance                       busiest worker over the mean, 1.0 is perfectly balanced
+//      busy_seconds                    busy time of every worker, separated by ';'
+//      cycles, instructions, llc_misses, branch_misses
+//                                      hardware counters summed over every worker during
+//                                      the search (counters.h), empty unless counted
+//      ipc                             instructions per cycle
+//      bytes_per_cycle                 bytes_scanned per cycle of every worker
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "counters.h"
+
+#define MAX_WORKERS 256
+
+typedef struct
+{
+    int test;
+    int searchMode;
+    int textNumber;
+    int patternNumber;
+    long textLength;
+    long patternLength;
+    long loadNanos;
+    long searchNanos;
+    long bytesScanned;
+    long comparisons;
+    long matches;
+    int workers;
+    long busyNanos[MAX_WORKERS];
+    int counted; // whether hardware counters were read
+    long long counters[COUNTER_EVENTS]; // -1 for an event not available
+} TestMetrics;
+
+/// <summary>
+/// Clears a metrics record and stores the control entry it belongs to.
+/// </summary>
+/// <param name="metrics">The record to reset.</param>
+/// <param name="test">The index of the test.</param>
+/// <param name="searchMode">The search mode of the test.</param>
+/// <param name="textNumber">The text number of the test.</param>
+/// <param name="patternNumber">The pattern number of the test.</param>
+void resetMetrics(TestMetrics* metrics, int test, int searchMode, int textNumber, int patternNumber)
+{
+    memset(metrics, 0, sizeof(TestMetrics));
+    metrics->test = test;
+    metrics->searchMode = searchMode;
+    metrics->textNumber = textNumber;
+    metrics->patternNumber = patternNumber;
+}
+
+/// <summary>
+/// Creates the run report, replacing any report of a previous run, and writes the header. A
+/// resumed run appends to the report of the run it continues, which keeps the tests before its
+/// checkpoint, and writes the header only if the report is new.
+/// </summary>
+/// <param name="fileName">The name of the report file.</param>
+/// <param name="append">Whether to append to an existing report.</param>
+/// <returns>The open report, or NULL if it could not be created.</returns>
+FILE* openReport(char* fileName, int append)
+{
+    FILE* f = fopen(fileName, append ? "a" : "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "openReport: could not open file %s\n", fileName);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) > 0)
+        return f;
+
+    fprintf(f, "test,mode,text,pattern,text_length,pattern_length,load_seconds,search_seconds,"
+        "bytes_scanned,comparisons,matches,workers,busy_min_seconds,busy_max_seconds,imbalance,busy_seconds,"
+        "cycles,instructions,llc_misses,branch_misses,ipc,bytes_per_cycle\n");
+    return f;
+}
+
+/// <summary>
+/// Appends the metrics of a test to the run report.
+/// </summary>
+/// <param name="f">The open report.</param>
+/// <param name="metrics">The metrics of the test.</param>
+void writeReport(FILE* f, TestMetrics* metrics)
+{
+    if (f == NULL)
+        return;
+
+    long minBusy = 0, maxBusy = 0, totalBusy = 0;
+    int i;
+    for (i = 0; i < metrics->workers; i++)
+    {
+        long busy = metrics->busyNanos[i];
+        if (i == 0 || busy < minBusy)
+            minBusy = busy;
+        if (busy > maxBusy)
+            maxBusy = busy;
+        totalBusy += busy;
+    }
+    double imbalance = totalBusy > 0 ? (double)maxBusy * metrics->workers / (double)totalBusy : 1.0;
+
+    fprintf(f, "%i,%i,%i,%i,%li,%li,%.09f,%.09f,%li,%li,%li,%i,%.09f,%.09f,%.3f,",
+        metrics->test, metrics->searchMode, metrics->textNumber, metrics->patternNumber,
+        metrics->textLength, metrics->patternLength,
+        (double)metrics->loadNanos / 1.0e9, (double)metrics->searchNanos / 1.0e9,
+        metrics->bytesScanned, metrics->comparisons, metrics->matches, metrics->workers,
+        (double)minBusy / 1.0e9, (double)maxBusy / 1.0e9, imbalance);
+
+    for (i = 0; i < metrics->workers; i++)
+    {
+        fprintf(f, i ? ";%.09f" : "%.09f", (double)metrics->busyNanos[i] / 1.0e9);
+    }
+
+    for (i = 0; i < COUNTER_EVENTS; i++)
+    {
+        if (metrics->counted && metrics->counters[i] >= 0)
+            fprintf(f, ",%lld", metrics->counters[i]);
+        else
+            fprintf(f, ",");
+    }
+
+    long long cycles = metrics->counted ? metrics->counters[COUNTER_CYCLES] : 0;
+    long long instructions = metrics->counters[COUNTER_INSTRUCTIONS];
+    if (cycles > 0 && instructions >= 0)
+        fprintf(f, ",%.3f", (double)instructions / (double)cycles);
+    else
+        fprintf(f, ",");
+    if (cycles > 0)
+        fprintf(f, ",%.3f", (double)metrics->bytesScanned / (double)cycles);
+    else
+        fprintf(f, ",");
+    fprintf(f, "\n");
+}
+
+#endif
@@ -0,0 +1,176 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: placement.h
+// Description: NUMA placement helpers for project_OMP. Threads can be
+// pinned to one CPU each, the socket a thread runs on can be found,
+// and memory can be interleaved across every NUMA node. Used by the
+// -numa option of project_OMP, which also reports the bandwidth each
+// socket achieved.
+//
+// Sockets are NUMA nodes when built with -DNUMA and linked with
+// -lnuma, otherwise the physical package of the CPU is used. Without
+// -DNUMA memory cannot be interleaved. On systems other than Linux
+// threads are not pinned and every thread is reported on socket 0.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef NUMA
+#include <numa.h>
+#endif
+
+#define MAX_SOCKETS 16
+#define PAGE_SIZE 4096
+
+#ifdef __linux__
+// CPUs the process may run on, read before any thread is pinned
+cpu_set_t allowedCpus;
+int allowedCpuCount;
+#endif
+
+/// <summary>
+/// Reads the CPUs the process may run on. Must be called before the threads are pinned.
+/// </summary>
+void readAllowedCpus()
+{
+#ifdef __linux__
+    if (sched_getaffinity(0, sizeof(allowedCpus), &allowedCpus) == 0)
+        allowedCpuCount = CPU_COUNT(&allowedCpus);
+    else
+        allowedCpuCount = 0;
+#endif
+}
+
+/// <summary>
+/// Pins the calling thread to one of the allowed CPUs. Threads are spread evenly over the
+/// allowed CPUs, so a team smaller than the machine uses every socket.
+/// </summary>
+/// <param name="thread">The number of the calling thread.</param>
+/// <param name="threads">The number of threads in the team.</param>
+/// <returns>1 if the thread was pinned, otherwise 0.</returns>
+int pinThread(int thread, int threads)
+{
+#ifdef __linux__
+    if (allowedCpuCount == 0)
+        return 0;
+
+    int index = (int)((long)thread * allowedCpuCount / threads);
+    int cpu;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowedCpus) && index-- == 0)
+        {
+            cpu_set_t target;
+            CPU_ZERO(&target);
+            CPU_SET(cpu, &target);
+            return sched_setaffinity(0, sizeof(target), &target) == 0;
+        }
+    }
+#endif
+    return 0;
+}
+
+/// <summary>
+/// Gets the socket of the CPU the calling thread is running on.
+/// </summary>
+/// <returns>The socket number, or 0 if it is unknown.</returns>
+int currentSocket()
+{
+    int socket = 0;
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu < 0)
+        return 0;
+
+#ifdef NUMA
+    if (numa_available() >= 0)
+    {
+        socket = numa_node_of_cpu(cpu);
+        return socket >= 0 && socket < MAX_SOCKETS ? socket : 0;
+    }
+#endif
+
+    char fileName[100];
+    sprintf(fileName, "/sys/devices/system/cpu/cpu%i/topology/physical_package_id", cpu);
+    FILE* f = fopen(fileName, "r");
+    if (f != NULL)
+    {
+        if (fscanf(f, "%i", &socket) != 1)
+            socket = 0;
+        fclose(f);
+    }
+#endif
+    return socket >= 0 && socket < MAX_SOCKETS ? socket : 0;
+}
+
+/// <summary>
+/// Interleaves the pages of a block of memory across every NUMA node. Must be called before
+/// the memory is first touched, and the memory must be page aligned.
+/// </summary>
+/// <param name="data">The memory to interleave.</param>
+/// <param name="length">The length of the memory in bytes.</param>
+/// <returns>1 if the memory is interleaved, otherwise 0.</returns>
+int interleaveMemory(void* data, long length)
+{
+#ifdef NUMA
+    if (numa_available() >= 0)
+    {
+        numa_interleave_memory(data, length, numa_all_nodes_ptr);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/// <summary>
+/// Writes the bandwidth achieved by each socket. The bandwidth of a socket is the text it
+/// scanned over the mean time its threads were busy, so it is the rate the socket's threads
+/// read text together.
+/// </summary>
+/// <param name="f">The file to write to.</param>
+/// <param name="threads">The number of threads.</param>
+/// <param name="threadSocket">The socket of each thread.</param>
+/// <param name="threadBytes">The text positions scanned by each thread.</param>
+/// <param name="threadBusy">The time each thread was busy searching, in nanoseconds.</param>
+/// <param name="socketPlaced">The characters of text first touched by each socket.</param>
+/// <param name="interleaved">The characters of text interleaved across every socket.</param>
+void writeSocketReport(FILE* f, int threads, int threadSocket[], long threadBytes[], long threadBusy[],
+    long socketPlaced[], long interleaved)
+{
+    int socket, t;
+
+    fprintf(f, "socket,threads,placed_bytes,scanned_bytes,busy_seconds,gb_per_s\n");
+    for (socket = 0; socket < MAX_SOCKETS; socket++)
+    {
+        int count = 0;
+        long bytes = 0, busy = 0;
+        for (t = 0; t < threads; t++)
+        {
+            if (threadSocket[t] == socket)
+            {
+                count++;
+                bytes += threadBytes[t];
+                busy += threadBusy[t];
+            }
+        }
+        if (count == 0 && socketPlaced[socket] == 0)
+            continue;
+
+        double seconds = count > 0 ? (double)busy / count / 1.0e9 : 0.0;
+        fprintf(f, "%i,%i,%li,%li,%.09f,%.3f\n", socket, count, socketPlaced[socket], bytes, seconds,
+            seconds > 0 ? (double)bytes / seconds / 1.0e9 : 0.0);
+    }
+    if (interleaved > 0)
+        fprintf(f, "interleaved,0,%li,0,0,0\n", interleaved);
+}
+
+#endif
@@ -0,0 +1,224 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: pool.h
+// Description: Per process memory reuse for project_MPI. Buffers whose
+// size follows the test, such as the slice of text, the pattern and the
+// locations found, are pool buffers which grow geometrically and are
+// kept for every later test. Small arrays needed only while a test
+// runs, such as the workload and displacement of each process, come
+// from an arena which is reset after each test, so neither is allocated
+// and freed per test once the largest test has been seen.
+//
+// The memory held by pool buffers and arenas is tracked, and the peak
+// of each process is reported with the peak resident set size at the
+// end of the run.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef DOS
+#include <sys/resource.h>
+#endif
+
+#define ARENA_ALIGNMENT 16
+#define MIN_POOL_BYTES 1024
+
+// memory held by the pool buffers and arenas of this process, and its peak over the run
+long pooledBytes;
+long pooledPeak;
+
+// a buffer kept across tests, which only ever grows
+typedef struct
+{
+    void* data;
+    long capacity; // bytes
+} PoolBuffer;
+
+// memory allocated by an arena which did not fit in its block
+typedef struct Overflow
+{
+    struct Overflow* next;
+} Overflow;
+
+// memory handed out in order and released all at once
+typedef struct
+{
+    char* data;
+    long capacity;
+    long used;
+    long wanted; // bytes allocated since the last reset, including overflow
+    Overflow* overflow;
+    long overflowBytes;
+} Arena;
+
+/// <summary>
+/// Records a change in the memory held by the pools, updating the peak.
+/// </summary>
+/// <param name="bytes">The bytes added, or removed if negative.</param>
+void trackPooled(long bytes)
+{
+    pooledBytes += bytes;
+    if (pooledBytes > pooledPeak)
+        pooledPeak = pooledBytes;
+}
+
+/// <summary>
+/// Makes sure a pool buffer holds at least a number of bytes, keeping its contents. The buffer
+/// at least doubles whenever it grows, so a run of growing tests reallocates it only a few times.
+/// </summary>
+/// <param name="buffer">The buffer to grow.</param>
+/// <param name="bytes">The number of bytes needed.</param>
+/// <returns>The data of the buffer.</returns>
+void* poolReserve(PoolBuffer* buffer, long bytes)
+{
+    if (bytes <= buffer->capacity)
+        return buffer->data;
+
+    long capacity = buffer->capacity ? buffer->capacity * 2 : MIN_POOL_BYTES;
+    if (capacity < bytes)
+        capacity = bytes;
+
+    void* data = realloc(buffer->data, capacity);
+    if (data == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(0);
+    }
+    trackPooled(capacity - buffer->capacity);
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return data;
+}
+
+/// <summary>
+/// Takes back a pool buffer which was grown by someone else, such as a search growing its array
+/// of locations.
+/// </summary>
+/// <param name="buffer">The buffer.</param>
+/// <param name="data">The data of the buffer, which may have moved.</param>
+/// <param name="bytes">The capacity of the buffer in bytes.</param>
+void poolAdopt(PoolBuffer* buffer, void* data, long bytes)
+{
+    trackPooled(bytes - buffer->capacity);
+    buffer->data = data;
+    buffer->capacity = bytes;
+}
+
+/// <summary>
+/// Frees a pool buffer.
+/// </summary>
+void poolRelease(PoolBuffer* buffer)
+{
+    trackPooled(-buffer->capacity);
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+}
+
+/// <summary>
+/// Allocates memory from an arena, valid until the arena is reset. Memory which does not fit in
+/// the arena's block is allocated separately, and the block grows to fit it at the next reset.
+/// </summary>
+/// <param name="arena">The arena.</param>
+/// <param name="bytes">The number of bytes.</param>
+/// <returns>The memory, aligned to ARENA_ALIGNMENT.</returns>
+void* arenaAlloc(Arena* arena, long bytes)
+{
+    bytes = (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    arena->wanted += bytes;
+
+    if (arena->used + bytes <= arena->capacity)
+    {
+        void* memory = arena->data + arena->used;
+        arena->used += bytes;
+        return memory;
+    }
+
+    // the header keeps the memory aligned
+    Overflow* overflow = (Overflow*)malloc(ARENA_ALIGNMENT + bytes);
+    if (overflow == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(0);
+    }
+    trackPooled(ARENA_ALIGNMENT + bytes);
+    arena->overflowBytes += ARENA_ALIGNMENT + bytes;
+    overflow->next = arena->overflow;
+    arena->overflow = overflow;
+    return (char*)overflow + ARENA_ALIGNMENT;
+}
+
+/// <summary>
+/// Releases everything allocated from an arena. If the last use did not fit in the block, the
+/// block grows to at least twice its size so the next use does.
+/// </summary>
+/// <param name="arena">The arena.</param>
+void arenaReset(Arena* arena)
+{
+    while (arena->overflow != NULL)
+    {
+        Overflow* next = arena->overflow->next;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+    trackPooled(-arena->overflowBytes);
+    arena->overflowBytes = 0;
+
+    if (arena->wanted > arena->capacity)
+    {
+        long capacity = arena->capacity ? arena->capacity * 2 : MIN_POOL_BYTES;
+        if (capacity < arena->wanted)
+            capacity = arena->wanted;
+
+        free(arena->data);
+        arena->data = (char*)malloc(capacity);
+        if (arena->data == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(0);
+        }
+        trackPooled(capacity - arena->capacity);
+        arena->capacity = capacity;
+    }
+
+    arena->used = 0;
+    arena->wanted = 0;
+}
+
+/// <summary>
+/// Gets the peak resident set size of the process.
+/// </summary>
+/// <returns>The peak resident set size in kilobytes, or 0 if it is unknown.</returns>
+long peakResidentKb()
+{
+#ifndef DOS
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+/// <summary>
+/// Writes the peak memory of every process.
+/// </summary>
+/// <param name="f">The file to write to.</param>
+/// <param name="nProc">The number of processes.</param>
+/// <param name="peaks">The peak pooled bytes and peak resident kilobytes of each process, in pairs.</param>
+void writeMemoryReport(FILE* f, int nProc, long peaks[])
+{
+    int n;
+    fprintf(f, "rank,pooled_peak_bytes,resident_peak_kb\n");
+    for (n = 0; n < nProc; n++)
+    {
+        fprintf(f, "%i,%li,%li\n", n, peaks[2 * n], peaks[2 * n + 1]);
+    }
+}
+
+#endif
@@ -8,20 +8,111 @@
 // master slave model. 
 // The master:
 //      Reads the data
-//      Loops over the test cases provided by the control file
+//      Reads the test cases of the control file in batches, and runs each
+//      batch grouped by text and then pattern
 //      Computes and sends the workloads to the slaves
 //      Searches its own portion of text
 //      Receives results from slaves
-//      Writes results to file
+//      Writes the results of each batch to file in control order
 //      Informs slaves if they should stop
 //
 // The slaves:
-//      Receive data from the master and search for the pattern
+//      Receive data from the master and search for the pattern, keeping
+//      their slice of text for the following tests of the same text
 //      Send the result back to the master if there is any
 //      Wait for master to inform them if all tests are complete and they should stop working
 //
+// Search modes of a control entry:
+//      0   find any occurrence, writes -2 if found
+//      1   find all occurrences, writes the index of each occurrence
+//      2   count occurrences, writes the number of occurrences. Counts are
+//          summed with MPI_Reduce so no locations are sent to the master
+//      3   find the first N occurrences in text order, writes the index of
+//          each. N is the fourth value of the control entry, "3 text pattern N",
+//          and defaults to 1. Slaves stop once every process before them has
+//          finished and found N occurrences between them
+//
+// Each process searches its portion of text with the search library
+// (search.h), which also divides the text among the processes. An entry
+// "mode text pattern limit start end" only finds occurrences within
+// characters start to end - 1 of the text (control.h): only that range
+// is divided, sent and searched, and each portion keeps its displacement
+// in the whole text, so locations are written as offsets in the text.
+//
+// Buffers used by every test are kept for the whole run (pool.h): the
+// text, pattern and locations grow geometrically in pool buffers, and
+// the arrays of a single test come from an arena reset after it. The
+// peak memory of every process is written at the end of the run.
+//
+// As tests of a batch which search the same text run one after another,
+// each process's slice of the text is sent once, extended for the
+// longest pattern of the batch searched in it, and kept by the slaves
+// for every following test of that text.
+//
+// Texts and patterns with the same contents share one buffer, as do a
+// file and a prefix of it (content.h). Tests are grouped, and slices
+// kept, by content ID, so a text identical to another is never sent
+// again, and a test of the same search as one already run copies its
+// results without involving the slaves.
+//
+// A test which the tuning profile (tuning.h) finds faster searched by
+// one process than by every process, such as a short text whose slices
+// take longer to send than to search, is searched by the master alone,
+// without involving the slaves.
+//
+// Usage: project_MPI <directory> [-mpiio] [-halo] [-counters] [-profile file] [-calibrate [file]] [-prefetch] [-lazy]
+//                    [-checkpoint [n]] [-resume]
+//        project_MPI -calibrate [file]
+//      -mpiio          each process formats the locations it finds in
+//                      search mode 1 itself, rather than sending them to the
+//                      master, and every process writes its results into
+//                      result_MPI.txt with one collective MPI-IO write per
+//                      batch, at offsets found with MPI_Exscan, so the file
+//                      is the same as when the master writes it
+//      -halo           the master sends each slave a disjoint slice of the
+//                      text, and each slave extends its slice with the first
+//                      patternLength - 1 characters of its right neighbour's
+//                      with MPI_Sendrecv, so the master sends each character
+//                      once. Texts too short for every slice to hold the
+//                      extension are sent extended as before
+//      -counters       reads the hardware counters of every process around
+//                      its search and adds their sum to the run report, with
+//                      IPC and bytes scanned per cycle (counters.h)
+//      -profile file   the tuning profile to load (default tuning_MPI.txt)
+//      -calibrate [file]
+//                      writes synthetic texts and patterns of each bucket
+//                      to calibration_MPI, runs them searched by the master
+//                      alone and by every process, and writes the faster of
+//                      each bucket to the tuning profile (default
+//                      tuning_MPI.txt), instead of running the control file.
+//                      The directory is not read and may be left out, as in
+//                      "project_MPI -calibrate", and -mpiio is ignored
+//      -prefetch       the master reads the texts and patterns on a loader
+//                      thread in the order the control file names them
+//                      (loader.h), while the tests run on those already
+//                      read, so each test waits only for its own files
+//      -lazy           the master reads only the texts and patterns the
+//                      control file names, when a test first needs them or
+//                      ahead of the tests with -prefetch, and frees each
+//                      once the last test naming it has run (loader.h)
+//      -checkpoint [n] the master writes a checkpoint to checkpoint_MPI.txt
+//                      each time the results of a batch are written
+//                      (checkpoint.h), with batches of at most n tests
+//                      (default 1024). With -mpiio the results file is
+//                      synced first
+//      -resume         truncates result_MPI.txt to the length recorded by the
+//                      checkpoint and continues after its last test, or
+//                      empties it and starts from the first test if there is
+//                      no checkpoint. Implies -checkpoint
+// With -prefetch or -lazy, files are not shared by contents. Both are
+// ignored if the MPI library does not support MPI_THREAD_FUNNELED.
+//
 /////////////////////////////////////////////////////////////////////
 
+#ifdef __linux__
+#define _GNU_SOURCE // syscall, used by counters.h
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -30,25 +121,128 @@
 #include <dirent.h>
 #include <mpi.h>
 
+#ifdef DOS
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "checkpoint.h"
+#include "content.h"
+#include "control.h"
+#include "counters.h"
+#include "loader.h"
+#include "metrics.h"
+#include "pool.h"
+#include "search.h"
+#include "synthetic.h"
+#include "tuning.h"
+
 #define MAX_TEXTS 20
 #define MAX_PATTERNS 20 // based on assumptions from assignment brief
 
-#define MAX_TESTS 1024
-
-#define BYTES_PER_LINE 20 // 4 bytes per character * 5 characters
-#define BUFFER_SIZE 2000
+// control entries read and run together
+#define CONTROL_WINDOW 1024
 
 #define MASTER 0
 
+// calibration: the directory of the synthetic inputs, runs of each configuration, the fastest
+// of which is kept, occurrences found by search mode 3, and copies of each pattern planted per
+// million characters
+#define CALIBRATION_DIRECTORY "calibration_MPI"
+#define CALIBRATION_REPEATS 3
+#define CALIBRATION_LIMIT 10
+#define CALIBRATION_MATCHES 10.0
+
 // message tag which master sends to processes still searching
 #define EXECUTE 66
 // message sent from slaves to master to indicate they completed their search 
 #define PROCESS_DONE 67
 
+// what the master broadcasts the slaves to do next
+#define NEXT_TEST 0 // search the test sent next
+#define NEXT_FINISHED 1 // every test is complete
+#define NEXT_WRITE 2 // write the results of a batch with MPI-IO
+#define NEXT_COPY 3 // copy the results of a test of the same search with MPI-IO
+
+// how the slices of a test's text are given to the slaves
+#define SLICES_KEPT 0 // the slaves keep the slices of the last test
+#define SLICES_EXTENDED 1 // the master sends each slice extended by patternLength - 1 characters
+#define SLICES_DISJOINT 2 // the master sends disjoint slices, extended from the right neighbour
+
 // using global variables greatly reduces the number of parameters needed for functions
 int procId; // process ID
 int nProc; // number of processes in program
 
+// whether the slaves extend disjoint slices from their neighbours, and the length of the slice
+// of a slave before it is extended
+int haloMode = 0;
+int sliceLength;
+
+// whether hardware counters are read around each search, and the counters of this process
+int countersMode = 0;
+Counters processCounters = { { -1, -1, -1, -1 } };
+
+// whether the master reads files on a loader thread as the tests run, and whether it reads only
+// files named by the control file and frees each after its last test
+int prefetchMode = 0;
+int lazyMode = 0;
+
+// whether a checkpoint is written after each batch, the file it is written to, the most tests
+// the master reads into a batch, and the control entries a resumed run skips
+int checkpointMode = 0;
+char* checkpointFileName = "checkpoint_MPI.txt";
+int batchLimit = CONTROL_WINDOW;
+long resumeTests = 0;
+
+// the tuning profile, whose buckets decide which tests the master searches alone, and the file
+// it is read from and written to by -calibrate
+TuningProfile tuning;
+char* profileFileName = "tuning_MPI.txt";
+
+// while calibrating, the number of processes every test is searched by, otherwise 0, and the
+// time taken by each test
+int calibrationRanks = 0;
+long calibrationNanos[CONTROL_WINDOW];
+
+// text lengths and pattern lengths timed by -calibrate
+const int calibrationSizes[] = { 4096, 16384, 65536, 262144, 1048576, 4194304 };
+const int calibrationPatterns[] = { 4, 16, 64 };
+
+// instrumentation of the test currently running, only filled in by the master
+TestMetrics metrics;
+char* reportFileName = "metrics_MPI.csv";
+char* outputFileName = "result_MPI.txt";
+
+// the batch of control entries being run and the order they run in, only used by the master, and
+// the results of each test. The master holds every result unless results are written with MPI-IO,
+// where each process holds the locations it found in search mode 1
+ControlEntry controlBatch[CONTROL_WINDOW];
+int runOrder[CONTROL_WINDOW];
+TestOutput testOutputs[CONTROL_WINDOW];
+int testMatches[CONTROL_WINDOW];
+
+// whether every process writes its own results, the results file they write, and the offset in
+// it of the next batch
+int mpiioMode = 0;
+MPI_File outputFile;
+MPI_Offset outputOffset;
+
+// state of an early terminating search, only used by the master
+int* doneCounts; // occurrences reported by each process, -1 while still searching
+char* stopSent; // whether each slave has been sent the message to stop searching
+int doneReceived; // number of slaves which have reported
+int anyOccurrence; // whether the search finishes as soon as any occurrence is found
+int searchLimit; // number of occurrences to find
+
+// memory reused by every test: arrays needed during one test, and the slice of text, pattern
+// and locations of this process
+Arena testArena;
+PoolBuffer textPool;
+PoolBuffer patternPool;
+PoolBuffer resultPool;
+PoolBuffer outputPool;
+
 #pragma region I/O Functions
 void outOfMemory()
 {
@@ -61,6 +255,17 @@ void printDebug()
     printf("\nStatement Reached!\n");
 }
 
+/// <summary>
+/// Gets the current time in nanoseconds.
+/// </summary
+/// <returns>The time in nanoseconds.</returns>
+long getNanos()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 void readFromFile(FILE* f, char** data, int* length)
 {
     int ch;
@@ -100,449 +305,314 @@ void readFromFile(FILE* f, char** data, int* length)
 /// <param name="filename">The Filename to identify which files to read.</param>
 /// <param name="data">The Character Array to store the read data.</param>
 /// <param name="lengths">The Integer Array to store the lengths of the files.</param>
+/// <param name="loadNanos">Array to store the time taken to read each file.</param>
 /// <returns>The number of files read.</returns>
-int readFiles(const int maxFiles, char* directory, char* filename, char* data[], int lengths[])
+int readFiles(const int maxFiles, char* directory, char* filename, char* data[], int lengths[], long loadNanos[])
 {
     int count = 0;
+    int number;
     FILE* f;
     char fileName[1000];
-    for (count; count < maxFiles; count++)
+    for (number = 0; number < maxFiles; number++)
     {
 #ifdef DOS
-        sprintf(fileName, "%s\\%s%i.txt", directory, filename, count);
+        sprintf(fileName, "%s\\%s%i.txt", directory, filename, number);
 #else
-        sprintf(fileName, "%s/%s%i.txt", directory, filename, count);
+        sprintf(fileName, "%s/%s%i.txt", directory, filename, number);
 #endif
 
+        long time = getNanos();
         f = fopen(fileName, "r");
+
+        // a missing file is left empty, and the files after it are still read
         if (f == NULL)
-            return 0;
+            continue;
 
-        readFromFile(f, &data[count], &lengths[count]);
-        //printf("read %s %i\n", filename, count);
+        readFromFile(f, &data[number], &lengths[number]);
+        //printf("read %s %i\n", filename, number);
         fclose(f);
-
+        loadNanos[number] = getNanos() - time;
+        count++;
     }
     return count;
-    }
-
-/// <summary>
-/// Read the test cases from the control file in the input directory, and load them into an array.
-/// </summary>
-/// <returns>The number of tests in the control file.</returns>
-int readControl(char* directory, char controlData[][3])
-{
-    FILE* f;
-    char fileName[1000];
-
-#ifdef DOS
-    sprintf(fileName, "%s\\control.txt", directory);
-#else
-    sprintf(fileName, "%s/control.txt", directory);
-#endif
-
-    f = fopen(fileName, "r");
-    if (f == NULL)
-        return 0;
-
-    int testCount = 0;
-    int readResult;
-
-    while ((readResult = fscanf(f, "%i %i %i", &controlData[testCount][0], &controlData[testCount][1], &controlData[testCount][2])) != EOF)
-    {
-        if (readResult == 3)
-        {
-            //printf("Read control entry %i\n", testCount);
-            //printf("%i %i %i\n\n", controlData[testCount][0], controlData[testCount][1], controlData[testCount][2]);
-            testCount++;
-        }
-        else
-        {
-            printf("End of Control File reached.\n\n");
-        }
-    }
-    fclose(f);
-
-    return testCount;
 }
 
+#pragma endregion
+
+#pragma region Helper Functions
 /// <summary>
-/// Writes the contents of a character buffer to file.
+/// Prints out the number of elements to be received by each process. 
+/// For Debugging purposes only.
 /// </summary>
-/// <param name="buffer">The character buffer to be written to file.</param>
-void writeBufferToOutput(char buffer[])
+/// <param name="procWorkload">Pointer to array containing the workloads for each elements.</param>
+/// <param name="nProc">The number of processes used in the program.</param>
+void debugPrintWorkload(int* procWorkload)
 {
-    FILE* f;
-    char fileName[1000];
-
-    sprintf(fileName, "result_MPI.txt");
-
-    f = fopen(fileName, "a+");
-    if (f == NULL)
+    int i;
+    for (i = 0; i < nProc; i++)
     {
-        fprintf(stderr, "writeBufferToOutput: could not open file %s", fileName);
-        return;
+        printf("\nProcess %i receiving %i elements\n", i, (*(procWorkload + i)));
     }
-    fprintf(f, buffer);
-    fclose(f);
-
-    // clear buffer
-    buffer[0] = '\0';
 }
 
 /// <summary>
-/// Writes a test result to the buffer.
+/// Prints out text displacement of each process
+/// For debugging purposes only.
 /// </summary>
-/// <param name="buffer">Character buffer to be written to.</param>
-/// <param name="textNumber">The Text number specified by the test case.</param>
-/// <param name="patternNumber">The Pattern number specified by the test case.</param>
-/// <param name="patternLocation">The location in the text the pattern was found.</param>
-void writeToBuffer(char buffer[], int textNumber, int patternNumber, int patternLocation)
+/// <param name="displacement">Pointer to array containing the displacements for each process.</param>
+/// <param name="nProc">The number of processes used in the program.</param>
+void debugPrintDisplacement(int* displacement)
 {
-    // write full buffer to output and clear
-    if (strlen(buffer) > BUFFER_SIZE - BYTES_PER_LINE)
+    int i;
+    for (i = 0; i < nProc; i++)
     {
-        writeBufferToOutput(buffer);
+        printf("\nProcess %i start at text index %i\n", i, (*(displacement + i)));
     }
-    // append new result to buffer
-    sprintf(buffer + strlen(buffer), "%i %i %i\n", textNumber, patternNumber, patternLocation);
 }
+
 #pragma endregion
 
-#pragma region Helper Functions
 /// <summary>
-/// Distributes text length among processes.
+/// Master side of an early terminating search. Records the number of occurrences a slave
+/// reports once it has finished searching.
 /// </summary>
-/// <param name="procWork">Array to contain the workload (length of allocated text) of each process.</param>
-/// <param name="nProc">Number of processes in the program.</param>
-/// <param name="textLength">The length of the full text.</param>
-void divideWorkload(int* procWork, int textLength, int patternLength)
+/// <param name="blocking">Whether to wait for a report, rather than only receive one that is waiting.</param>
+/// <returns>1 if a report was received, otherwise 0.</returns>
+int receiveDone(int blocking)
 {
-    // calculate the base number of elements for each process
-    int nElements = textLength / nProc;
+    MPI_Status status;
+    int message = 1;
 
-    // set base number of elements for each process i
-    int i;
-    for (i = 0; i < nProc; i++)
-    {
-        (*(procWork + i)) = nElements;
-    }
+    if (!blocking)
+        MPI_Iprobe(MPI_ANY_SOURCE, PROCESS_DONE, MPI_COMM_WORLD, &message, &status);
+
+    if (!message)
+        return 0;
 
-    int remainder = textLength % nProc;
+    int slaveResult;
+    MPI_Recv(&slaveResult, 1, MPI_INT, MPI_ANY_SOURCE, PROCESS_DONE, MPI_COMM_WORLD, &status);
+    doneCounts[status.MPI_SOURCE] = slaveResult;
+    doneReceived++;
+    return 1;
+}
 
-    // if there are no remainders, we can continue with the program
-    if (remainder > 0)
+/// <summary>
+/// Master side of an early terminating search. Decides whether the processes still searching
+/// can stop. When searching for any occurrence, the search is finished once any process finds
+/// the pattern. When searching for the first occurrences, the search is finished once every process 
+/// up to some process is done and they hold enough occurrences between them, since the slaves
+/// after it search later portions of the text.
+/// </summary>
+/// <returns>1 if the search is finished, otherwise 0.</returns>
+int searchFinished()
+{
+    int n;
+    int total = 0;
+    for (n = 0; n < nProc; n++)
     {
-        // assign remainders to slave processes
-        // we work backwards through processes such that only slave processes
-        // take on any extra workload
-        for (i = (nProc - 1); i > ((nProc - 1) - remainder); i--)
+        if (anyOccurrence)
         {
-            (*(procWork + i)) += 1;
+            if (doneCounts[n] > 0)
+                return 1;
         }
-    }
-
-    // if the pattern length is greater than 1, we assign extra work just 
-    // to detect any patterns occurring across processes
-    if (patternLength > 1)
-    {
-        // assign overflow to first processes
-        for (i = 0; i < (nProc - 1); i++)
+        else
         {
-            (*(procWork + i)) += patternLength;
-            if ((*(procWork + i)) > textLength)
-            {
-                (*(procWork + i)) -= ((*(procWork + i)) - textLength);
-            }
+            if (doneCounts[n] < 0)
+                return 0;
+            total += doneCounts[n];
+            if (total >= searchLimit)
+                return 1;
         }
     }
+    return 0;
 }
 
 /// <summary>
-/// Sets the displacement in the full text for each process.
+/// Master side of an early terminating search. Sends every slave that has not yet been sent one
+/// the message to stop searching. Each slave receives exactly one such message per test, either 
+/// while searching or after it has reported, so no messages are left over for the next test.
 /// </summary>
-/// <param name="displs">Array to contain the displacement of each process.</param>
-/// <param name="procWork">Array containing the workload of each process.</param>
-/// <param name="nProc">Number of processes in the program.</param>
-void setDisplacement(int* displs, int* procWork, int patternLength)
+void sendStops()
 {
-    int i;
-    // displacement at i dependent on i-1. We can set displs[0] to 0 since we know it starts there
-    displs[0] = 0;
-    for (i = 1; i < nProc; i++)
+    int n;
+    int message = 0;
+    for (n = 1; n < nProc; n++)
     {
-        if (patternLength == 1)
-            displs[i] = displs[i - 1] + (procWork[i - 1]);
-        else // if we are accounting for added pattern length, subtract from process work
-            displs[i] = displs[i - 1] + (procWork[i - 1] - patternLength); 
+        if (!stopSent[n])
+        {
+            MPI_Send(&message, 1, MPI_INT, n, EXECUTE, MPI_COMM_WORLD);
+            stopSent[n] = 1;
+        }
     }
 }
 
 /// <summary>
-/// Prints out the number of elements to be received by each process. 
-/// For Debugging purposes only.
+/// Master side of an early terminating search, polled by the search of the master's own portion.
+/// Records the reports of any slaves which have finished, and decides whether the search is finished.
 /// </summary>
-/// <param name="procWorkload">Pointer to array containing the workloads for each elements.</param>
-/// <param name="nProc">The number of processes used in the program.</param>
-void debugPrintWorkload(int* procWorkload)
+/// <param name="state">Unused.</param>
+/// <returns>1 if the master's search should stop, otherwise 0.</returns>
+int masterPoll(void* state)
 {
-    int i;
-    for (i = 0; i < nProc; i++)
-    {
-        printf("\nProcess %i receiving %i elements\n", i, (*(procWorkload + i)));
-    }
+    while (receiveDone(0))
+        ;
+    return searchFinished();
 }
 
 /// <summary>
-/// Prints out text displacement of each process
-/// For debugging purposes only.
+/// Slave side of an early terminating search, polled by the search of the slave's portion.
+/// Receives the message from the master to stop searching, if it has been sent.
 /// </summary>
-/// <param name="displacement">Pointer to array containing the displacements for each process.</param>
-/// <param name="nProc">The number of processes used in the program.</param>
-void debugPrintDisplacement(int* displacement)
+/// <param name="state">Unused.</param>
+/// <returns>1 if the slave's search should stop, otherwise 0.</returns>
+int slavePoll(void* state)
 {
-    int i;
-    for (i = 0; i < nProc; i++)
+    int message; // indicates whether or not a message is waiting to be received from master
+    int commMessage;
+
+    MPI_Iprobe(MASTER, EXECUTE, MPI_COMM_WORLD, &message, MPI_STATUS_IGNORE);
+    if (message) //receive message and stop searching
     {
-        printf("\nProcess %i start at text index %i\n", i, (*(displacement + i)));
+        MPI_Recv(&commMessage, 1, MPI_INT, MASTER, EXECUTE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        return 1;
     }
+    return 0;
 }
 
 /// <summary>
-/// Gets the current time in nanoseconds.
-/// </summary
-/// <returns>The time in nanoseconds.</returns>
-long getNanos()
-{
-    struct timespec ts;
-    timespec_get(&ts, TIME_UTC);
-    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
-}
-
-#pragma endregion
-
-/// <summary>
-/// Searches for any occurrences of a pattern, completing once an occurrence has been found.
-/// The master must probe for messages from the slaves indicating that they have completed their search.
-/// If the result sent by the slaves is 1 (indicating that pattern has been found) then the master
-/// messages all processes still searching that they should stop. Otherwise, the process is marked as complete
-/// so the master does not try to send future messages to that process.
-/// If the master finds the pattern, then it informs any remaining processes to stop their search.
+/// Searches for up to limit occurrences of a pattern in text order, completing early once the master 
+/// decides the search is finished. The master probes for messages from the slaves indicating that they 
+/// have completed their search and how many occurrences they found. Once the search is finished, 
+/// the master messages all processes still searching that they should stop.
 /// </summary>
 /// <param name="textData">The portion of Text to be searched.</param>
 /// <param name="patternData">The Pattern to search for.</param>
 /// <param name="textLength">The Length of the portion of Text.</param>
 /// <param name="patternLength">The Length of the Pattern.</param>
 /// <param name="displacement">The Displacement of the portion of Text.</param>
+/// <param name="limit">The maximum number of occurrences to find.</param>
+/// <param name="any">1 if the search finishes as soon as any process finds the pattern.</param>
+/// <param name="results">Where to store the locations of the occurrences, or NULL if they are not needed.</param>
+/// <param name="stats">Instrumentation of the search.</param>
 /// <returns>The number of occurrences of the Pattern within the portion of Text.</returns>
-int masterFindOccurrence(char* textData, char* patternData, int textLength, int patternLength, int displacement)
+int masterFindOccurrences(char* textData, char* patternData, int textLength, int patternLength, int displacement, int limit, int any, SearchResults* results, SearchStats* stats)
 {
-    MPI_Status status;
-    int masterTracker[4] = {0, 0, 0, 0}; // tracks search progress of other processes
-
-    int i, j, k;
-    int found = 0;
-
-    int lastI = textLength - patternLength;
-    printf("");
-    i = 0;
-    j = 0;
-    k = 0;
-
-    int message = 0; // indicates if a message is waiting to be received from slave
+    int i;
 
-    while (i <= lastI && j < patternLength)
+    // tracks search progress of the processes
+    doneCounts = (int*)arenaAlloc(&testArena, nProc * sizeof(int));
+    stopSent = (char*)arenaAlloc(&testArena, nProc * sizeof(char));
+    memset(stopSent, 0, nProc * sizeof(char));
+    for (i = 0; i < nProc; i++)
     {
-        if (textData[k] == patternData[j])
-        {
-            k++;
-            j++;
-        }
-        else
-        {
-            i++;
-            k = i;
-            j = 0;
-        }
-
-        // check for message from slaves
-        MPI_Iprobe(MPI_ANY_SOURCE, PROCESS_DONE, MPI_COMM_WORLD, &message, &status);
-
-        if (message)
-        {
-            int slaveResult = 0;
-
-            // revceive search result from slave
-            MPI_Recv(&slaveResult, 1, MPI_INT, MPI_ANY_SOURCE, PROCESS_DONE, MPI_COMM_WORLD, &status);
-            if (masterTracker[status.MPI_SOURCE]) //ensures slave can only send its result once
-                continue;
-
-            masterTracker[status.MPI_SOURCE] = 1; // indicates slave process has completed search
+        doneCounts[i] = -1;
+    }
+    doneReceived = 0;
+    anyOccurrence = any;
+    searchLimit = limit;
 
-            // if slave was successful, inform all other processes that are still searching to stop
-            if (slaveResult)
-            {
-                int n;
-                for (n = 1; n < 4; n++)
-                {
-                    if (!masterTracker[n])
-                    {
-                        MPI_Send(&found, 1, MPI_INT, MASTER, EXECUTE, MPI_COMM_WORLD);
-                    }
-                }
-                return found;
-            }
-        }
+    int found = searchSerial(any ? SEARCH_ANY : SEARCH_FIRST, textData, textLength, patternData, patternLength, limit,
+        displacement, masterPoll, NULL, results, stats);
 
-    }
+    // another process made the master's occurrences unnecessary
+    if (found == SEARCH_STOPPED)
+        found = 0;
+    doneCounts[MASTER] = found;
 
-    // if master finds the pattern, inform all other processes that are still searching to stop
-    if (j == patternLength)
+    // wait for every slave to report, stopping the remaining slaves once the search is finished
+    while (1)
     {
-        found = 1;
-        int n;
-        for (n = 1; n < 4; n++)
-        {
-            if (!masterTracker[n])
-            {
-                MPI_Send(&found, 1, MPI_INT, MASTER, EXECUTE, MPI_COMM_WORLD);
-            }
-        }
+        if (searchFinished())
+            sendStops();
+        if (doneReceived == nProc - 1)
+            break;
+        receiveDone(1);
     }
+    sendStops();
+
     // return the result
     return found;
-
 }
 
 /// <summary>
-/// Searches for any occurrences of a pattern, completing once an occurrence has been found.
-/// The slaves must probe for a message from the master which indicates that the pattern has already been
-/// found by another process. Otherwise, if a slave finds the pattern, or completes its search before a pattern
-/// has been found, it must inform the master that it has completed its search.
+/// Searches for up to limit occurrences of a pattern in text order, completing early if the master 
+/// messages that the search is finished. The slaves probe for the message from the master while 
+/// searching. Once a slave has completed its search, it informs the master how many occurrences it found,
+/// and waits for the message from the master if it has not already received it.
 /// </summary>
 /// <param name="textData">The portion of Text to be searched.</param>
 /// <param name="patternData">The Pattern to search for.</param>
 /// <param name="textLength">The Length of the portion of Text.</param>
 /// <param name="patternLength">The Length of the Pattern.</param>
 /// <param name="displacement">The Displacement of the portion of Text.</param>
+/// <param name="limit">The maximum number of occurrences to find.</param>
+/// <param name="any">1 if the search finishes as soon as any process finds the pattern.</param>
+/// <param name="results">Where to store the locations of the occurrences, or NULL if they are not needed.</param>
+/// <param name="stats">Instrumentation of the search.</param>
 /// <returns>The number of occurrences of the Pattern within the portion of Text.</returns>
-int slaveFindOccurrence(char* textData, char* patternData, int textLength, int patternLength, int displacement)
+int slaveFindOccurrences(char* textData, char* patternData, int textLength, int patternLength, int displacement, int limit, int any, SearchResults* results, SearchStats* stats)
 {
-    MPI_Status status;
-
-    int i, j, k;
-    int found = 0;
-
-    i = 0;
-    j = 0;
-    k = 0;
-
-    int lastI = textLength - patternLength;
+    int commMessage;
 
-    int message; // indicates whether or not a message is waiting to be received from master
-    
-
-    while (i <= lastI && j < patternLength && !found)
-    {
-        if (textData[k] == patternData[j])
-        {
-            k++;
-            j++;
-        }
-        else
-        {
-            i++;
-            k = i;
-            j = 0;
-        }
+    int found = searchSerial(any ? SEARCH_ANY : SEARCH_FIRST, textData, textLength, patternData, patternLength, limit,
+        displacement, slavePoll, NULL, results, stats);
 
-        // check for message from master
-        MPI_Iprobe(MASTER, EXECUTE, MPI_COMM_WORLD, &message, MPI_STATUS_IGNORE);
+    // the master only stops a slave once its occurrences are no longer needed
+    int stopped = found == SEARCH_STOPPED;
+    if (stopped)
+        found = 0;
 
-        if (message) //receive message and stop searching
-        {
-            int commMessage;
-            MPI_Recv(&commMessage, 1, MPI_INT, MASTER, EXECUTE, MPI_COMM_WORLD, &status);
-
-            return found;
-        }
-
-    }
+    // send result to master
+    MPI_Send(&found, 1, MPI_INT, MASTER, PROCESS_DONE, MPI_COMM_WORLD);
 
-    // if pattern is found by slave
-    if (j == patternLength)
+    if (!stopped)
     {
-        found = 1;
+        MPI_Recv(&commMessage, 1, MPI_INT, MASTER, EXECUTE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
     }
-    // send result to master
-    MPI_Send(&found, 1, MPI_INT, MASTER, PROCESS_DONE, MPI_COMM_WORLD);
 
     // return result
     return found;
 }
 
 /// <summary>
-/// Searches for all occurrences of a pattern, only completing once the 
-/// entire portion of text has been searched.
+/// Gathers the busy time and instrumentation counters of every process to the master,
+/// accumulating them into the metrics of the current test.
 /// </summary>
-/// <param name="textData">The portion of Text to be searched.</param>
-/// <param name="patternData">The Pattern to search for.</param>
-/// <param name="displacement">The Displacement of the portion of Text.</param>
-/// <param name="textLength">The Length of the portion of Text.</param>
-/// <param name="patternLength">The Length of the Pattern.</param>
-/// <param name="results">Array of integer results to store location of Pattern occurrences.</param>
-/// <returns>The number of occurrences of the Pattern within the portion of Text.</returns>
-int findAllOccurrences(char* textData, char* patternData, int displacement, int textLength, int patternLength, int** results)
+/// <param name="busy">The time this process spent searching.</param>
+/// <param name="stats">Instrumentation of this process' search.</param>
+/// <param name="counters">The hardware counters of this process' search, -1 for an event not available.</param>
+void gatherMetrics(long busy, SearchStats* stats, long long counters[COUNTER_EVENTS])
 {
-    int i, j, k;
+    long long local[3 + COUNTER_EVENTS] = { busy, stats->positions, stats->comparisons };
+    long long* all = NULL;
+    int e;
+
+    for (e = 0; e < COUNTER_EVENTS; e++)
+    {
+        local[3 + e] = counters[e];
+    }
 
-    // we allocate an array within this function and set the value of results to it
-    int* occurrences = (int*)malloc(sizeof(int));
+    if (procId == MASTER)
+        all = (long long*)arenaAlloc(&testArena, (3 + COUNTER_EVENTS) * nProc * sizeof(long long));
 
-    i = 0;
-    j = 0;
-    k = 0;    
-    
-    int lastI = textLength - patternLength;
-    int found = 0;
+    MPI_Gather(local, 3 + COUNTER_EVENTS, MPI_LONG_LONG, all, 3 + COUNTER_EVENTS, MPI_LONG_LONG, MASTER, MPI_COMM_WORLD);
 
-    while (i <= lastI)
+    if (procId == MASTER)
     {
-        if (textData[k] == patternData[j])
-        {
-            ++k;
-            ++j;
-
-            // if we find the pattern, resize the occurrences array and add the result
-            if (j == patternLength)
-            {                
-                found++;
-                if (found > 1)
-                {
-                    occurrences = (int*)realloc(occurrences, found * sizeof(int));
-                    occurrences[found - 1] = (i + displacement);
-                }
-                else
-                    occurrences[found-1] = (i + displacement);
-            }
-        }
-        else
+        int n;
+        long long none[COUNTER_EVENTS] = { 0 };
+        metrics.workers = nProc < MAX_WORKERS ? nProc : MAX_WORKERS;
+        metrics.counted = countersMode;
+        for (n = 0; n < nProc; n++)
         {
-            i++;
-            k = i;
-            j = 0;
+            long long* process = all + (3 + COUNTER_EVENTS) * n;
+            if (n < MAX_WORKERS)
+                metrics.busyNanos[n] = (long)process[0];
+            metrics.bytesScanned += (long)process[1];
+            metrics.comparisons += (long)process[2];
+            addCounters(metrics.counters, none, process + 3);
         }
     }
-
-    // set results only if we find the pattern
-    if (found > 0)
-    {
-        *results = occurrences;
-    }
-
-    // return result
-    return found;
-
 }
 
 /// <summary>
@@ -550,271 +620,756 @@ int findAllOccurrences(char* textData, char* patternData, int displacement, int
 /// </summary>
 /// <param name="searchMode">The Search Mode used to determine which searching algorithm to use.
 /// 0 - Find any occurrence
-/// 1 - Find all occurrences</param>
+/// 1 - Find all occurrences
+/// 2 - Count occurrences
+/// 3 - Find the first occurrences</param>
 /// <param name="textData">The portion of Text to be searched.</param>
 /// <param name="patternData">The Pattern to search for.</param>
 /// <param name="displacement">The displacement of the portion of text.</param>
 /// <param name="textLength">The length of the portion of text to search.</param>
 /// <param name="patternLength">The length of the pattern.</param>
-/// <param name="results">Array of integer results to store locations of any found patterns.</param>
+/// <param name="limit">The number of occurrences to find in search mode 3.</param>
+/// <param name="results">Set to the locations of any found patterns, held in resultPool until the next test.</param>
 /// <returns>The number of pattern occurrences found in the text.</returns>
-int processData(int searchMode, char* textData, char* patternData, int displacement, int textLength, int patternLength, int** results)
+int processData(int searchMode, char* textData, char* patternData, int displacement, int textLength, int patternLength, int limit, int** results)
 {
     MPI_Barrier(MPI_COMM_WORLD);
+
+    // locations are stored in the result pool, which the search grows geometrically when it is full
+    SearchResults locations = { (int*)resultPool.data, (int)(resultPool.capacity / sizeof(int)), 1, 0, NULL, NULL };
+    SearchStats stats;
+    long long counterStart[COUNTER_EVENTS];
+    long long counterEnd[COUNTER_EVENTS];
+    readCounters(&processCounters, counterStart);
+    long busy = getNanos();
+
+    int found;
     if (searchMode == 0) // find any occurrence
     {
         int result;
         if (procId == MASTER) // master has unique set of functions to complete whilst searching
-            result = masterFindOccurrence(textData, patternData, textLength, patternLength, displacement);
+            result = masterFindOccurrences(textData, patternData, textLength, patternLength, displacement, 1, 1, NULL, &stats);
         else // slaves must send results of search to master so they have a unique search
-            result = slaveFindOccurrence(textData, patternData, textLength, patternLength, displacement);
+            result = slaveFindOccurrences(textData, patternData, textLength, patternLength, displacement, 1, 1, NULL, &stats);
 
-        *results = (int*)malloc(1 * sizeof(int));
+        *results = (int*)poolReserve(&resultPool, sizeof(int));
         if (result)
         {
             *results[0] = -2; // set -2 for finding any occurrence
-            return 1; // only interested if pattern occurs, not in the number of occurrences
         }
-        return 0;
-        
+        found = result ? 1 : 0; // only interested if pattern occurs, not in the number of occurrences
     }
-    else
+    else if (searchMode == 3) // find the first occurrences, using the same early termination as search mode 0
     {
-        // pass search results into the function and assign the results to it
-        int* searchResults = (int*)malloc(sizeof(int));
-        int found = findAllOccurrences(textData, patternData, displacement, textLength, patternLength, &searchResults);
-        *results = searchResults;
-        return found;
+        if (procId == MASTER)
+            found = masterFindOccurrences(textData, patternData, textLength, patternLength, displacement, limit, 0, &locations, &stats);
+        else
+            found = slaveFindOccurrences(textData, patternData, textLength, patternLength, displacement, limit, 0, &locations, &stats);
+    }
+    else // count occurrences, where there are no locations to return, or find all occurrences
+    {
+        found = searchSerial(searchMode, textData, textLength, patternData, patternLength, limit, displacement,
+            NULL, NULL, &locations, &stats);
+    }
+
+    if (searchMode != 0)
+    {
+        poolAdopt(&resultPool, locations.locations, (long)locations.capacity * sizeof(int));
+        *results = locations.locations;
     }
+
+    busy = getNanos() - busy;
+    readCounters(&processCounters, counterEnd);
+
+    long long counters[COUNTER_EVENTS] = { 0 };
+    addCounters(counters, counterStart, counterEnd);
+    gatherMetrics(busy, &stats, counters);
+
+    return found;
 }
 
 /// <summary>
-/// Master instructions: Master reads in text, pattern and control data. For each test, the master
-/// calculates workload distribution and displacements, then sends the relevant search data to the slaves,
-/// carries out its own search before receiving the search results of the slaves and writing them to file.
-/// Finally, if the master has completed all tests, it sends a finish flag to the slaves.
+/// Extends the slice of text of a slave with the first characters of the slice of the slave to
+/// its right, so an occurrence starting in the slice and ending in the next is found by this
+/// slave only. The last slave has no neighbour and is not extended. Called by every slave.
 /// </summary>
-/// <param name="directory">The directory to read the data from.</param>
-void processMaster(char* directory)
+/// <param name="halo">The number of characters to extend the slice by.</param>
+void exchangeHalo(int halo)
 {
+    int left = procId > 1 ? procId - 1 : MPI_PROC_NULL;
+    int right = procId < nProc - 1 ? procId + 1 : MPI_PROC_NULL;
 
-#pragma region Declarations
-
-    // initialize data variables within master process
-
-    char buffer[BUFFER_SIZE];
-    buffer[0] = '\0';
-
-    char* textData[MAX_TEXTS];
-    int textLengths[MAX_TEXTS];
-    int textCount = readFiles(MAX_TEXTS, directory, "text", textData, textLengths);
+    char* slice = (char*)poolReserve(&textPool, (long)sliceLength + halo);
+    MPI_Sendrecv(slice, halo, MPI_CHAR, left, 2,
+        slice + sliceLength, halo, MPI_CHAR, right, 2,
+        MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
 
-    char* patternData[MAX_PATTERNS];
-    int patternLengths[MAX_PATTERNS];
-    int patternCount = readFiles(MAX_PATTERNS, directory, "pattern", patternData, patternLengths);
+/// <summary>
+/// Checks whether the locations found by each process are written by the process itself, which is
+/// when results are written with MPI-IO and every location is written, as in search mode 1.
+/// </summary>
+/// <param name="searchMode">The search mode of the test.</param>
+/// <returns>1 if each process writes its own locations.</returns>
+int writesOwnResults(int searchMode)
+{
+    return mpiioMode && searchMode != 0 && searchMode != 2 && searchMode != 3;
+}
 
-    char controlData[MAX_TESTS][3];
-    int numberOfTests = readControl(directory, controlData);
+/// <summary>
+/// Writes the results of a batch of tests in control order with one collective write, each process
+/// writing the results it holds. The results of a test are written in process order, so locations
+/// stay in text order. Called by every process.
+/// </summary>
+/// <param name="batchSize">The number of tests in the batch.</param>
+void writeOutputsCollective(int batchSize)
+{
+    long long* lengths = (long long*)arenaAlloc(&testArena, batchSize * sizeof(long long));
+    long long* before = (long long*)arenaAlloc(&testArena, batchSize * sizeof(long long));
+    long long* totals = (long long*)arenaAlloc(&testArena, batchSize * sizeof(long long));
+    MPI_Aint* pieceOffsets = (MPI_Aint*)arenaAlloc(&testArena, batchSize * sizeof(MPI_Aint));
+    int* pieceLengths = (int*)arenaAlloc(&testArena, batchSize * sizeof(int));
+    long bytes = 0;
+    int s;
+
+    for (s = 0; s < batchSize; s++)
+    {
+        lengths[s] = testOutputs[s].length;
+        before[s] = 0;
+        bytes += testOutputs[s].length;
+    }
 
-#pragma endregion
+    // the results of lower processes come first in each test, every process's come first in the next
+    MPI_Exscan(lengths, before, batchSize, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (procId == MASTER)
+        memset(before, 0, batchSize * sizeof(long long));
+    MPI_Allreduce(lengths, totals, batchSize, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    // the results of this process are gathered into one buffer, and placed by the file view
+    char* data = (char*)poolReserve(&outputPool, bytes + 1);
+    long long testOffset = 0;
+    int pieces = 0;
+    bytes = 0;
+    for (s = 0; s < batchSize; s++)
+    {
+        if (lengths[s] > 0)
+        {
+            pieceOffsets[pieces] = (MPI_Aint)(testOffset + before[s]);
+            pieceLengths[pieces] = (int)lengths[s];
+            memcpy(data + bytes, testOutputs[s].data, lengths[s]);
+            bytes += (long)lengths[s];
+            pieces++;
+        }
+        testOffset += totals[s];
+        testOutputs[s].length = 0;
+    }
 
-    long programTime = getNanos();
-    int testNumber;
-    for (testNumber = 0; testNumber < numberOfTests; testNumber++)
+    MPI_Datatype pieceType = MPI_CHAR;
+    if (pieces > 0)
     {
-        long time = getNanos();
+        MPI_Type_create_hindexed(pieces, pieceLengths, pieceOffsets, MPI_CHAR, &pieceType);
+        MPI_Type_commit(&pieceType);
+    }
+    MPI_File_set_view(outputFile, outputOffset, MPI_CHAR, pieceType, "native", MPI_INFO_NULL);
+    MPI_File_write_at_all(outputFile, 0, data, (int)bytes, MPI_CHAR, MPI_STATUS_IGNORE);
+    if (pieces > 0)
+        MPI_Type_free(&pieceType);
 
-        // test variables
-        int searchMode = controlData[testNumber][0];
-        int textIndex = controlData[testNumber][1];
-        int patternIndex = controlData[testNumber][2];
+    // a checkpoint only counts results which have reached the file
+    if (checkpointMode)
+        MPI_File_sync(outputFile);
 
-        int testTextLength = textLengths[textIndex];
-        int testPatternLength = patternLengths[patternIndex];
+    outputOffset += testOffset;
+    arenaReset(&testArena);
+}
 
-        // check if text is shorter than pattern
-        if (testTextLength < testPatternLength)
-        {
-            printf("Test %i: Text shorter than Pattern.\n", testNumber);
+/// <summary>
+/// Searches a text, or the range of it a test searches, on the master alone, for a test the slaves
+/// would only slow down, and records its instrumentation in the metrics of the current test.
+/// </summary>
+/// <param name="searchMode">The search mode.</param>
+/// <param name="textData">The text to search.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="displacement">The position of the text in the whole text, added to every location.</param>
+/// <param name="patternData">The pattern to search for.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="limit">The number of occurrences to find in search mode 3.</param>
+/// <param name="results">Set to the locations of any found patterns, held in resultPool until the next test.</param>
+/// <returns>The result of the search mode.</returns>
+int searchAlone(int searchMode, char* textData, int textLength, int displacement, char* patternData, int patternLength, int limit,
+    int** results)
+{
+    SearchResults locations = { (int*)resultPool.data, (int)(resultPool.capacity / sizeof(int)), 1, 0, NULL, NULL };
+    SearchStats stats;
+    long long counterStart[COUNTER_EVENTS];
+    long long counterEnd[COUNTER_EVENTS];
+    readCounters(&processCounters, counterStart);
+    long busy = getNanos();
+
+    int found = searchSerial(searchMode, textData, textLength, patternData, patternLength, limit, displacement,
+        NULL, NULL, &locations, &stats);
+
+    poolAdopt(&resultPool, locations.locations, (long)locations.capacity * sizeof(int));
+    *results = locations.locations;
+
+    busy = getNanos() - busy;
+    readCounters(&processCounters, counterEnd);
+
+    metrics.workers = 1;
+    metrics.busyNanos[0] = busy;
+    metrics.bytesScanned = stats.positions;
+    metrics.comparisons = stats.comparisons;
+    metrics.counted = countersMode;
+    addCounters(metrics.counters, counterStart, counterEnd);
+    return found;
+}
 
-            writeToBuffer(buffer, textIndex, patternIndex, -1);
-            continue;
+/// <summary>
+/// Writes the result of a test to its output.
+/// </summary>
+/// <param name="output">The output of the test.</param>
+/// <param name="searchMode">The search mode.</param>
+/// <param name="textIndex">The text number of the test.</param>
+/// <param name="patternIndex">The pattern number of the test.</param>
+/// <param name="total">The result of the search mode over every process.</param>
+/// <param name="results">The locations held by the master.</param>
+/// <param name="written">The number of locations held by the master.</param>
+void appendResults(TestOutput* output, int searchMode, int textIndex, int patternIndex, int total, int* results, int written)
+{
+    if (searchMode == 2) // search mode 2, writes the number of occurrences, including 0
+    {
+        appendOutput(output, textIndex, patternIndex, total);
+    }
+    else if (total > 0)
+    {
+        // search mode 0, always writes -2 to file
+        if (!searchMode)
+        {
+            appendOutput(output, textIndex, patternIndex, -2);
+        }
+        else // search modes 1 and 3, write actual text index to file
+        {
+            int i;
+            for (i = 0; i < written; i++)
+            {
+                appendOutput(output, textIndex, patternIndex, results[i]);
+            }
         }
 
-        // store number of elements each process receives
-        int* displs = (int*)malloc(nProc * sizeof(int));
-        int* procWorkload = (int*)malloc(nProc * sizeof(int));
-
-#pragma region Send Data
-
-        // send pattern length first so slaves know
-        // how large the received pattern is
-        MPI_Bcast(&testPatternLength,
-            1, MPI_INT, MASTER,
-            MPI_COMM_WORLD);
+    }
+    else // no pattern found, write -1 to file
+    {
+        appendOutput(output, textIndex, patternIndex, -1);
+    }
+}
 
-        // send entire pattern to slaves
-        MPI_Bcast(patternData[patternIndex],
-            testPatternLength, MPI_CHAR, MASTER,
-            MPI_COMM_WORLD);
+/// <summary>
+/// Releases the text and pattern of a test which has run, in lazy loading, freeing them after
+/// the last test naming them.
+/// </summary>
+/// <param name="loader">The loader of the files.</param>
+/// <param name="entry">The control entry of the test.</param>
+void releaseTest(Loader* loader, ControlEntry* entry)
+{
+    if (!lazyMode)
+        return;
+    releaseFile(loader, &loader->texts, entry->textNumber);
+    releaseFile(loader, &loader->patterns, entry->patternNumber);
+}
 
-        MPI_Bcast(&searchMode,
-            1, MPI_INT, MASTER,
-            MPI_COMM_WORLD);
+/// <summary>
+/// Master instructions: Master reads in text, pattern and control data. For each test, the master
+/// calculates workload distribution and displacements, then sends the relevant search data to the slaves,
+/// carries out its own search before receiving the search results of the slaves and writing them to file.
+/// Finally, if the master has completed all tests, it sends a finish flag to the slaves.
+/// </summary>
+/// <param name="directory">The directory to read the data from.</param>
+void processMaster(char* directory)
+{
 
-        // divide the workload among the processes
-        divideWorkload(procWorkload, testTextLength, testPatternLength);
+#pragma region Declarations
 
+    // initialize data variables within master process
 
-        // get the displacement within the text for each process
-        setDisplacement(displs, procWorkload, testPatternLength);
+    // files not read are left empty
+    char* textData[MAX_TEXTS] = { NULL };
+    int textLengths[MAX_TEXTS] = { 0 };
+    long textLoadNanos[MAX_TEXTS] = { 0 };
 
-        //debugPrintWorkload(procWorkload);
-        debugPrintDisplacement(displs);
+    char* patternData[MAX_PATTERNS] = { NULL };
+    int patternLengths[MAX_PATTERNS] = { 0 };
+    long patternLoadNanos[MAX_PATTERNS] = { 0 };
 
-        int nElements;
-        // scatter workload to processes so they know how many elements are being received
-        MPI_Scatter(procWorkload, 1,
-            MPI_INT, &nElements, 1,
-            MPI_INT, MASTER,
-            MPI_COMM_WORLD);
+    int textIds[MAX_TEXTS];
+    int patternIds[MAX_PATTERNS];
 
-        int masterDispls;
-        // scatter the displacement to get the actual text index and not the relative index
-        MPI_Scatter(displs, 1,
-            MPI_INT, &masterDispls, 1,
-            MPI_INT, MASTER,
-            MPI_COMM_WORLD);
+    // the file whose buffer each file shares, each file's own when files are not shared
+    int textOwners[MAX_TEXTS];
+    int patternOwners[MAX_PATTERNS];
+    Loader loader;
+    int loaderMode = prefetchMode || lazyMode;
+    int i;
 
-        // we use send instead of scatterv as we had done previously, since we address patterns across processes
-        // by simply adding the length of the pattern to the first workload, which means the total workload of the
-        // processes is greater than the size of the text
-        int n;
-        for (n = 1; n < nProc; n++)
+    if (loaderMode)
+    {
+        // every file is its own content, since the tests start before the files are compared
+        for (i = 0; i < MAX_TEXTS; i++)
+        {
+            textIds[i] = textOwners[i] = i;
+        }
+        for (i = 0; i < MAX_PATTERNS; i++)
         {
-            int dis = (*(displs+n));
-            int work = (*(procWorkload + n));
-            MPI_Send(&textData[textIndex][dis],
-                work, MPI_CHAR,
-                n, 1, MPI_COMM_WORLD);
+            patternIds[i] = patternOwners[i] = i;
         }
 
+        loader.printReads = 0;
+        loader.prefetch = prefetchMode;
+        loader.lazy = lazyMode;
+        loader.skip = resumeTests;
+        startLoader(&loader, directory, MAX_TEXTS, textData, textLengths, textLoadNanos,
+            MAX_PATTERNS, patternData, patternLengths, patternLoadNanos, readFromFile);
+    }
+    else
+    {
+        readFiles(MAX_TEXTS, directory, "text", textData, textLengths, textLoadNanos);
+        readFiles(MAX_PATTERNS, directory, "pattern", patternData, patternLengths, patternLoadNanos);
+
+        // files with the same contents, or which are a prefix of another, share one buffer
+        long shared = shareContents("text", MAX_TEXTS, textData, textLengths, textIds, textOwners);
+        shared += shareContents("pattern", MAX_PATTERNS, patternData, patternLengths, patternIds, patternOwners);
+        if (shared > 0)
+            printf("%li bytes of texts and patterns shared\n", shared);
+    }
+
+    // control entries are read as the tests run, so the first test starts at once
+    ControlReader* control = (ControlReader*)malloc(sizeof(ControlReader));
+    if (control == NULL)
+        outOfMemory();
+    openControl(control, directory, MAX_TEXTS, MAX_PATTERNS);
+    int batchStart = (int)skipControlEntries(control, resumeTests);
+
+    // the content ID and range of the text whose slices the slaves hold, the longest pattern the slices were
+    // extended for, and whether the slices were sent disjoint and extended by the slaves
+    int shippedText = -1;
+    int shippedStart = 0;
+    int shippedEnd = 0;
+    int shippedPatternLength = 0;
+    int shippedDisjoint = 0;
+
+    // run report is written next to the results, and continued by a resumed run
+    FILE* report = openReport(reportFileName, resumeTests > 0);
+
+    // the tuning profile decides which tests the master searches alone, unless calibrating
+    if (calibrationRanks == 0 && loadTuning(&tuning, profileFileName) >= 0)
+        printf("Tuning profile %s: %i buckets\n", profileFileName, tuning.count);
+
 #pragma endregion
 
-        // get results
+    long programTime = getNanos();
+    while (1)
+    {
+        int batchSize = 0;
+        while (batchSize < batchLimit && nextControlEntry(control, &controlBatch[batchSize]))
+        {
+            batchSize++;
+        }
+        if (batchSize == 0)
+            break;
 
-        // process master workload
-        int* results = NULL;
-        int found = processData(searchMode, textData[textIndex], patternData[patternIndex], masterDispls, nElements, testPatternLength, &results);
-        
-        // get results from slave processes
-        int total = found;
-        int j = found;
-        
-        for (n = 1; n < nProc; n++)
+        // tests of the same text run one after another, their results are written in control order
+        orderControl(controlBatch, batchSize, textIds, patternIds, runOrder);
+
+        int k;
+        for (k = 0; k < batchSize; k++)
         {
-            // receive number of found instances by the process
-            int procFound;
-            MPI_Recv(&procFound, 1, MPI_INT,
-                n, 0,
-                MPI_COMM_WORLD,
-                MPI_STATUS_IGNORE);
+            int slot = runOrder[k];
+            int testNumber = batchStart + slot;
+            ControlEntry entry = controlBatch[slot];
+            TestOutput* output = &testOutputs[slot];
+
+            // a test waits only for its own files
+            if (loaderMode)
+            {
+                waitForFile(&loader, &loader.texts, entry.textNumber);
+                waitForFile(&loader, &loader.patterns, entry.patternNumber);
+            }
+            long time = getNanos();
+
+            // test variables
+            int searchMode = entry.mode;
+            int textIndex = entry.textNumber;
+            int patternIndex = entry.patternNumber;
+            int limit = entry.limit;
+
+            int testPatternLength = patternLengths[patternIndex];
+
+            // only the range of the text the test searches is divided among the processes
+            int rangeStart, rangeEnd;
+            controlRange(&entry, textLengths[textIndex], &rangeStart, &rangeEnd);
+            int testTextLength = rangeEnd - rangeStart;
+
+            resetMetrics(&metrics, testNumber, searchMode, textIndex, patternIndex);
+            metrics.textLength = textLengths[textIndex];
+            metrics.patternLength = testPatternLength;
 
-            // only continue if there are not 0 results
-            if (procFound == 0)
+            // tests of the same search run one after another, after other tests of the same contents
+            int copyFrom = -1;
+            int j;
+            for (j = k - 1; j >= 0 && copyFrom < 0; j--)
             {
+                ControlEntry* other = &controlBatch[runOrder[j]];
+                if (textIds[other->textNumber] != textIds[textIndex] || patternIds[other->patternNumber] != patternIds[patternIndex])
+                    break;
+                if (sameSearch(other, &entry, textIds, patternIds))
+                    copyFrom = runOrder[j];
+            }
+            if (copyFrom >= 0)
+            {
+                printf("Test %i: Same search as test %i.\n", testNumber, batchStart + copyFrom);
+
+                // with MPI-IO the slaves hold some of the results, and copy them too
+                if (mpiioMode)
+                {
+                    int next = NEXT_COPY;
+                    int copy[4] = { slot, textIndex, patternIndex, copyFrom };
+                    MPI_Bcast(&next, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+                    MPI_Bcast(copy, 4, MPI_INT, MASTER, MPI_COMM_WORLD);
+                }
+
+                copyOutput(output, &testOutputs[copyFrom], textIndex, patternIndex);
+                metrics.matches = testMatches[slot] = testMatches[copyFrom];
+                writeReport(report, &metrics);
+                releaseTest(&loader, &entry);
                 continue;
             }
 
-            // receive data from process
-            int* result = (int*)malloc(procFound * sizeof(int));
-            MPI_Recv(result, procFound,
-                MPI_INT, n, 0,
-                MPI_COMM_WORLD,
-                MPI_STATUS_IGNORE);
+            // check if text is shorter than pattern
+            if (testTextLength < testPatternLength)
+            {
+                printf("Test %i: Text shorter than Pattern.\n", testNumber);
 
-            // add received results to total
-            total += procFound;
+                appendOutput(output, textIndex, patternIndex, searchMode == 2 ? 0 : -1);
+                testMatches[slot] = 0;
+                writeReport(report, &metrics);
+                releaseTest(&loader, &entry);
+                continue;
+            }
 
-            results = (int*)realloc(results, total * sizeof(int));
+            // tests of a bucket faster on one process are searched by the master alone
+            int ranks = calibrationRanks;
+            if (ranks == 0)
+            {
+                TuningEntry* tuned = findTuning(&tuning, testTextLength, testPatternLength, searchMode);
+                ranks = tuned != NULL ? tuned->ranks : 0;
+            }
+            if (ranks == 1)
+            {
+                long searchTime = getNanos();
+                metrics.loadNanos = textLoadNanos[textIndex] + patternLoadNanos[patternIndex];
 
-            int i;
-            for (i = 0; i < procFound; i++, j++)
+                int* results = NULL;
+                int total = searchAlone(searchMode, textData[textIndex] + rangeStart, testTextLength, rangeStart,
+                    patternData[patternIndex], testPatternLength, limit, &results);
+
+                time = getNanos() - time;
+                printf("\nTest %i elapsed time = %.09f\n\n", testNumber, (double)time / 1.0e9);
+                if (calibrationRanks)
+                    calibrationNanos[testNumber] = time;
+
+                metrics.searchNanos = getNanos() - searchTime;
+                metrics.matches = testMatches[slot] = (searchMode == 0 && total > 0) ? 1 : total;
+                writeReport(report, &metrics);
+
+                appendResults(output, searchMode, textIndex, patternIndex, total, results, total);
+                releaseTest(&loader, &entry);
+                continue;
+            }
+
+            // store number of elements each process receives
+            int* displs = (int*)arenaAlloc(&testArena, nProc * sizeof(int));
+            int* procWorkload = (int*)arenaAlloc(&testArena, nProc * sizeof(int));
+
+    #pragma region Send Data
+
+            // tell the slaves another test follows
+            int next = NEXT_TEST;
+            MPI_Bcast(&next, 1, MPI_INT,
+                MASTER, MPI_COMM_WORLD);
+
+            // with MPI-IO the slaves write their own results, which they need the test to number
+            if (mpiioMode)
             {
-                results[j] = result[i];
+                int test[3] = { slot, textIndex, patternIndex };
+                MPI_Bcast(test, 3, MPI_INT, MASTER, MPI_COMM_WORLD);
             }
 
-            free(result);
+            // send pattern length first so slaves know
+            // how large the received pattern is
+            MPI_Bcast(&testPatternLength,
+                1, MPI_INT, MASTER,
+                MPI_COMM_WORLD);
 
-        }
+            // send entire pattern to slaves
+            MPI_Bcast(patternData[patternIndex],
+                testPatternLength, MPI_CHAR, MASTER,
+                MPI_COMM_WORLD);
 
-        
+            MPI_Bcast(&searchMode,
+                1, MPI_INT, MASTER,
+                MPI_COMM_WORLD);
 
-        time = getNanos() - time;
-        printf("\nTest %i elapsed time = %.09f\n\n", testNumber, (double)time / 1.0e9);
+            // number of occurrences to find in search mode 3
+            MPI_Bcast(&limit,
+                1, MPI_INT, MASTER,
+                MPI_COMM_WORLD);
 
-        // write result to file
-        if (total > 0)
-        {
-            // search mode 0, always writes -2 to file
-            if (!searchMode)
+            // get the displacement within the text for each process, dividing only the range
+            searchSetDisplacement(nProc, displs, testTextLength);
+            for (j = 0; j < nProc; j++)
             {
-                writeToBuffer(buffer, textIndex, patternIndex, -2);
-                //printf("Test %i, search mode %i, text %i, pattern %i, found patterns at %i\n", testNumber, searchMode, textIndex, patternIndex, -2);
+                displs[j] += rangeStart;
             }
-            else // search mode 1, writes actual text index to file
+
+            // the slices held by the slaves are reused if they hold the same range and were extended for a
+            // pattern at least as long
+            int distribution[2] = { SLICES_KEPT, 0 };
+            int sameSlices = textIds[textIndex] == shippedText && rangeStart == shippedStart && rangeEnd == shippedEnd;
+            if (!sameSlices || testPatternLength > shippedPatternLength)
             {
-                //printf("Test %i, search mode %i, text %i, pattern %i, found %i patterns at ", testNumber, searchMode, textIndex, patternIndex, total);
-                int i;
-                for (i = 0; i < total; i++)
+                // extend the slices for the longest pattern the following tests of the range search for
+                int extension = testPatternLength;
+                for (j = k + 1; j < batchSize && textIds[controlBatch[runOrder[j]].textNumber] == textIds[textIndex]; j++)
+                {
+                    // a pattern not yet read is sent for when its test runs
+                    ControlEntry* later = &controlBatch[runOrder[j]];
+                    int p = later->patternNumber;
+                    if (later->start != entry.start || later->end != entry.end)
+                        continue;
+                    if (loaderMode && !fileLoaded(&loader, &loader.patterns, p))
+                        continue;
+
+                    int length = patternLengths[p];
+                    if (length > extension && length <= testTextLength)
+                        extension = length;
+                }
+
+                // disjoint slices are extended by their right neighbour, which needs every slice to be
+                // at least as long as the extension
+                if (haloMode && testTextLength / nProc >= extension - 1)
                 {
-                    writeToBuffer(buffer, textIndex, patternIndex, results[i]);
-                    //printf("%i ", results[i]);
+                    if (!sameSlices || !shippedDisjoint)
+                        distribution[0] = SLICES_DISJOINT;
+                    distribution[1] = extension - 1;
                 }
-                //printf("\n");
+                else
+                {
+                    distribution[0] = SLICES_EXTENDED;
+                }
+                shippedText = textIds[textIndex];
+                shippedStart = rangeStart;
+                shippedEnd = rangeEnd;
+                shippedPatternLength = extension;
+                shippedDisjoint = haloMode && distribution[0] != SLICES_EXTENDED;
             }
+            MPI_Bcast(distribution,
+                2, MPI_INT, MASTER,
+                MPI_COMM_WORLD);
 
-        }
-        else // no pattern found, write -1 to file
-        {
-            //printf("Test %i, search mode %i, text %i, pattern %i, found patterns at %i\n", testNumber, searchMode, textIndex, patternIndex, -1);
-            writeToBuffer(buffer, textIndex, patternIndex, -1);
-        }
+            int n;
+            if (distribution[0] != SLICES_KEPT)
+            {
+                searchDivideWorkload(nProc, procWorkload, testTextLength, distribution[0] == SLICES_DISJOINT ? 1 : shippedPatternLength);
+
+                // scatter the length of each slice so the slaves know how many elements are being received
+                int shippedElements;
+                MPI_Scatter(procWorkload, 1,
+                    MPI_INT, &shippedElements, 1,
+                    MPI_INT, MASTER,
+                    MPI_COMM_WORLD);
+
+                // we use send instead of scatterv as we had done previously, since we address patterns across processes
+                // by simply adding the length of the pattern (less one) to the first workloads, which means the total workload
+                // of the processes is greater than the size of the text. Disjoint slices are sent without the overlap
+                for (n = 1; n < nProc; n++)
+                {
+                    int dis = (*(displs+n));
+                    int work = (*(procWorkload + n));
+                    MPI_Send(&textData[textIndex][dis],
+                        work, MPI_CHAR,
+                        n, 1, MPI_COMM_WORLD);
+                }
+            }
+
+            // divide the workload among the processes
+            searchDivideWorkload(nProc, procWorkload, testTextLength, testPatternLength);
+
+            //debugPrintWorkload(procWorkload);
+            debugPrintDisplacement(displs);
+
+            int nElements;
+            // scatter workload to processes so they know how many elements are being received
+            MPI_Scatter(procWorkload, 1,
+                MPI_INT, &nElements, 1,
+                MPI_INT, MASTER,
+                MPI_COMM_WORLD);
+
+            int masterDispls;
+            // scatter the displacement to get the actual text index and not the relative index
+            MPI_Scatter(displs, 1,
+                MPI_INT, &masterDispls, 1,
+                MPI_INT, MASTER,
+                MPI_COMM_WORLD);
+
+    #pragma endregion
+
+            // get results
+
+            // loading covers reading the files and distributing the slices
+            long searchTime = getNanos();
+            metrics.loadNanos = textLoadNanos[textIndex] + patternLoadNanos[patternIndex] + (searchTime - time);
+
+            // process master workload
+            int* results = NULL;
+            int found = processData(searchMode, textData[textIndex] + masterDispls, patternData[patternIndex], masterDispls, nElements, testPatternLength, limit, &results);
+        
+            // get results from slave processes
+            int total = found;
+            int ownResults = writesOwnResults(searchMode);
+
+            if (searchMode == 2 || ownResults)
+            {
+                // counts are summed directly, no locations are sent to the master
+                MPI_Reduce(&found, &total, 1, MPI_INT,
+                    MPI_SUM, MASTER,
+                    MPI_COMM_WORLD);
+            }
+            else
+            {
+                for (n = 1; n < nProc; n++)
+                {
+                    // receive number of found instances by the process
+                    int procFound;
+                    MPI_Recv(&procFound, 1, MPI_INT,
+                        n, 0,
+                        MPI_COMM_WORLD,
+                        MPI_STATUS_IGNORE);
+
+                    // only continue if there are not 0 results
+                    if (procFound == 0)
+                    {
+                        continue;
+                    }
+
+                    // receive data from process directly after the results already held
+                    results = (int*)poolReserve(&resultPool, (long)(total + procFound) * sizeof(int));
+                    MPI_Recv(results + total, procFound,
+                        MPI_INT, n, 0,
+                        MPI_COMM_WORLD,
+                        MPI_STATUS_IGNORE);
+
+                    // add received results to total
+                    total += procFound;
+
+                }
+            }
+
+            // results are received in text order, so only the first are kept in search mode 3
+            if (searchMode == 3 && total > limit)
+                total = limit;
 
+            time = getNanos() - time;
+            printf("\nTest %i elapsed time = %.09f\n\n", testNumber, (double)time / 1.0e9);
+            if (calibrationRanks)
+                calibrationNanos[testNumber] = time;
 
-        // free arrays
-        free(results);
-        free(procWorkload);
-        free(displs);
+            metrics.searchNanos = getNanos() - searchTime;
+            metrics.matches = testMatches[slot] = (searchMode == 0 && total > 0) ? 1 : total;
+            writeReport(report, &metrics);
 
-        // send message to slaves to keep waiting for new data or to stop
-        int finished = testNumber == (numberOfTests - 1);
-        MPI_Bcast(&finished, 1, MPI_INT,
-            MASTER, MPI_COMM_WORLD);
+            // write result to file, when each process writes its own locations the master holds only its own
+            appendResults(output, searchMode, textIndex, patternIndex, total, results, ownResults ? found : total);
 
+            // the arrays of this test are released, the pools are kept for the next test
+            arenaReset(&testArena);
+            releaseTest(&loader, &entry);
+        }
+
+        if (mpiioMode)
+        {
+            int next = NEXT_WRITE;
+            MPI_Bcast(&next, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+            MPI_Bcast(&batchSize, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+            writeOutputsCollective(batchSize);
+        }
+        else
+        {
+            writeOutputs(outputFileName, testOutputs, batchSize);
+        }
+        batchStart += batchSize;
+        if (checkpointMode)
+            saveCheckpoint(checkpointFileName, batchStart, mpiioMode ? (long long)outputOffset : resultsLength(outputFileName));
     }
+    printf("End of Control File reached.\n\n");
+    closeControl(control);
+    free(control);
+    if (loaderMode)
+        stopLoader(&loader);
+
+    // tell the slaves there are no more tests, which also releases them when every test was
+    // skipped or the control file is empty
+    int next = NEXT_FINISHED;
+    MPI_Bcast(&next, 1, MPI_INT,
+        MASTER, MPI_COMM_WORLD);
 
     programTime = getNanos() - programTime;
     printf("\n\nProgram elapsed time = %.09f\n\n", (double)programTime / 1.0e9);
 
-    // in case buffer hasn't done so, we write buffer data to file
-    writeBufferToOutput(buffer);
+    if (report != NULL)
+        fclose(report);
 
+    // the files are read again by each run of the calibration
+    freeContents(MAX_TEXTS, textData, textOwners);
+    freeContents(MAX_PATTERNS, patternData, patternOwners);
 }
 
 /// <summary>
 /// Slave instructions: Receive relevant search data and perform a search before sending 
-/// the result of the search back to the master. Receive the broadcasted finished flag to
+/// the result of the search back to the master. Receive what to do next from the master before each test to
 /// determine if slaves should continue to receive data.
 /// </summary>
 void processSlave()
 {
 
     // tracks whether or not there are still tests to complete
-    int finished = 0;
+    int next = NEXT_TEST;
 
-    while (!finished)
+    while (1)
     {
+        // the master announces each test before sending its data, and when there are no more
+        MPI_Bcast(&next,
+            1, MPI_INT, MASTER,
+            MPI_COMM_WORLD);
+        if (next == NEXT_FINISHED)
+            break;
+
+        if (next == NEXT_WRITE)
+        {
+            int batchSize;
+            MPI_Bcast(&batchSize, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+            writeOutputsCollective(batchSize);
+            continue;
+        }
+
+        // the slot, text and pattern numbers of the test, only sent when results are written with MPI-IO
+        int test[4] = { 0, 0, 0, 0 };
+        if (next == NEXT_COPY)
+        {
+            MPI_Bcast(test, 4, MPI_INT, MASTER, MPI_COMM_WORLD);
+            copyOutput(&testOutputs[test[0]], &testOutputs[test[3]], test[1], test[2]);
+            continue;
+        }
+        if (mpiioMode)
+            MPI_Bcast(test, 3, MPI_INT, MASTER, MPI_COMM_WORLD);
 
 #pragma region Declarations and Data Recept
 
@@ -830,8 +1385,8 @@ void processSlave()
             1, MPI_INT, MASTER,
             MPI_COMM_WORLD);
 
-        // allocate memory for pattern data
-        patternData = (char*)malloc(patternLength * sizeof(char));
+        // pattern data is kept in a pool buffer reused by every test
+        patternData = (char*)poolReserve(&patternPool, patternLength * sizeof(char));
 
         // receive pattern data after getting the number of received elements
         MPI_Bcast(patternData,
@@ -843,6 +1398,40 @@ void processSlave()
             1, MPI_INT, MASTER,
             MPI_COMM_WORLD);
 
+        int limit;
+        MPI_Bcast(&limit,
+            1, MPI_INT, MASTER,
+            MPI_COMM_WORLD);
+
+        // receive whether the slice of text held from the last test is reused, and how far it is
+        // extended from the right neighbour
+        int distribution[2];
+        MPI_Bcast(distribution,
+            2, MPI_INT, MASTER,
+            MPI_COMM_WORLD);
+
+        if (distribution[0] != SLICES_KEPT)
+        {
+            // receive the length of the slice before the data
+            int shippedLength;
+            MPI_Scatter(NULL, 1,
+                MPI_INT, &shippedLength, 1,
+                MPI_INT, MASTER,
+                MPI_COMM_WORLD);
+
+            // text data is kept in a pool buffer reused by every test, grown to the number of received elements
+            textData = (char*)poolReserve(&textPool, shippedLength * sizeof(char));
+            MPI_Recv(textData, shippedLength,
+                MPI_CHAR, MASTER, 1,
+                MPI_COMM_WORLD,
+                MPI_STATUS_IGNORE);
+            sliceLength = shippedLength;
+        }
+
+        if (distribution[1] > 0)
+            exchangeHalo(distribution[1]);
+        textData = (char*)textPool.data;
+
         // receive the text length before the data
         MPI_Scatter(NULL, 1,
             MPI_INT, &textLength, 1,
@@ -856,68 +1445,345 @@ void processSlave()
             MPI_INT, MASTER,
             MPI_COMM_WORLD);
 
-        // allocate text data based on number of received elements
-        textData = (char*)malloc(textLength * sizeof(char));
-        // receive text data from master
-        MPI_Recv(textData, textLength,
-            MPI_CHAR, MASTER, 1,
-            MPI_COMM_WORLD,
-            MPI_STATUS_IGNORE);
-
 #pragma endregion
 
         // stores results of pattern search
         int* results = NULL;
-        int found = processData(searchMode, textData, patternData, startIndex, textLength, patternLength, &results);
+        int found = processData(searchMode, textData, patternData, startIndex, textLength, patternLength, limit, &results);
 
-        // sending results to master if there are any
-        MPI_Send(&found, 1, MPI_INT,
-            MASTER, 0,
-            MPI_COMM_WORLD);
+        if (searchMode == 2 || writesOwnResults(searchMode))
+        {
+            // counts are summed on the master, no locations are sent
+            MPI_Reduce(&found, NULL, 1, MPI_INT,
+                MPI_SUM, MASTER,
+                MPI_COMM_WORLD);
 
-        if (found > 0)
+            // with MPI-IO the locations are written by this process
+            int i;
+            for (i = 0; searchMode != 2 && i < found; i++)
+            {
+                appendOutput(&testOutputs[test[0]], test[1], test[2], results[i]);
+            }
+        }
+        else
         {
-            MPI_Send(results, found, MPI_INT, MASTER, 0,
+            // sending results to master if there are any
+            MPI_Send(&found, 1, MPI_INT,
+                MASTER, 0,
                 MPI_COMM_WORLD);
+
+            if (found > 0)
+            {
+                MPI_Send(results, found, MPI_INT, MASTER, 0,
+                    MPI_COMM_WORLD);
+            }
         }
 
-        free(results);
-        free(textData);
-        free(patternData);
+        arenaReset(&testArena);
+    }
 
-        // receive finish flag before trying to receive pattern data
-        MPI_Bcast(&finished,
-            1, MPI_INT, 0,
-            MPI_COMM_WORLD);
+}
+
+/// <summary>
+/// Gathers the peak pooled memory and peak resident set size of every process to the master,
+/// which writes them to stdout.
+/// </summary>
+void reportMemory()
+{
+    long local[2] = { pooledPeak, peakResidentKb() };
+    long* peaks = NULL;
+
+    if (procId == MASTER)
+        peaks = (long*)arenaAlloc(&testArena, 2 * nProc * sizeof(long));
+
+    MPI_Gather(local, 2, MPI_LONG, peaks, 2, MPI_LONG, MASTER, MPI_COMM_WORLD);
+
+    if (procId == MASTER)
+    {
+        printf("\n");
+        writeMemoryReport(stdout, nProc, peaks);
+    }
+    arenaReset(&testArena);
+}
+
+/// <summary>
+/// Writes the synthetic inputs of the calibration: a text of each length holding copies of a
+/// pattern of each length, and a control file searching each text for each pattern in every
+/// search mode. Test (t * patterns + p) * 4 + mode searches text t for pattern p.
+/// </summary>
+void writeCalibrationInputs()
+{
+    int nSizes = sizeof(calibrationSizes) / sizeof(calibrationSizes[0]);
+    int nPatterns = sizeof(calibrationPatterns) / sizeof(calibrationPatterns[0]);
+    char* text = (char*)malloc(calibrationSizes[nSizes - 1]);
+    char patterns[MAX_PATTERNS][64];
+    char fileName[1000];
+    FILE* f;
+    int t, p, mode;
+
+    if (text == NULL)
+        outOfMemory();
+
+#ifdef DOS
+    _mkdir(CALIBRATION_DIRECTORY);
+#else
+    mkdir(CALIBRATION_DIRECTORY, 0755);
+#endif
+    seedSynthetic(0);
 
+    for (p = 0; p < nPatterns; p++)
+    {
+        fillRandomText(patterns[p], calibrationPatterns[p], 4);
+#ifdef DOS
+        sprintf(fileName, "%s\\pattern%i.txt", CALIBRATION_DIRECTORY, p);
+#else
+        sprintf(fileName, "%s/pattern%i.txt", CALIBRATION_DIRECTORY, p);
+#endif
+        f = fopen(fileName, "wb");
+        if (f == NULL)
+            continue;
+        fwrite(patterns[p], 1, calibrationPatterns[p], f);
+        fclose(f);
     }
 
+    for (t = 0; t < nSizes; t++)
+    {
+        fillRandomText(text, calibrationSizes[t], 4);
+        for (p = 0; p < nPatterns; p++)
+        {
+            plantMatches(text, calibrationSizes[t], patterns[p], calibrationPatterns[p], CALIBRATION_MATCHES);
+        }
+#ifdef DOS
+        sprintf(fileName, "%s\\text%i.txt", CALIBRATION_DIRECTORY, t);
+#else
+        sprintf(fileName, "%s/text%i.txt", CALIBRATION_DIRECTORY, t);
+#endif
+        f = fopen(fileName, "wb");
+        if (f == NULL)
+            continue;
+        fwrite(text, 1, calibrationSizes[t], f);
+        fclose(f);
+    }
+
+#ifdef DOS
+    sprintf(fileName, "%s\\control.txt", CALIBRATION_DIRECTORY);
+#else
+    sprintf(fileName, "%s/control.txt", CALIBRATION_DIRECTORY);
+#endif
+    f = fopen(fileName, "w");
+    if (f != NULL)
+    {
+        for (t = 0; t < nSizes; t++)
+        {
+            for (p = 0; p < nPatterns; p++)
+            {
+                for (mode = 0; mode < 4; mode++)
+                {
+                    fprintf(f, "%i %i %i %i\n", mode, t, p, CALIBRATION_LIMIT);
+                }
+            }
+        }
+        fclose(f);
+    }
+
+    free(text);
+}
+
+/// <summary>
+/// Calibration mode: runs the synthetic inputs with every test searched by the master alone,
+/// and then by every process, and writes the faster of each bucket to the tuning profile.
+/// Called by every process.
+/// </summary>
+/// <param name="fileName">The tuning profile to write.</param>
+void calibrate(char* fileName)
+{
+    int nSizes = sizeof(calibrationSizes) / sizeof(calibrationSizes[0]);
+    int nPatterns = sizeof(calibrationPatterns) / sizeof(calibrationPatterns[0]);
+    int nTests = nSizes * nPatterns * 4;
+    long fastest[2][CONTROL_WINDOW];
+    int r, c, t;
+
+    // the results and run report of the calibration are kept with its inputs
+    outputFileName = CALIBRATION_DIRECTORY "/result_MPI.txt";
+    reportFileName = CALIBRATION_DIRECTORY "/metrics_MPI.csv";
+
+    if (procId == MASTER)
+        writeCalibrationInputs();
+
+    for (r = 0; r < CALIBRATION_REPEATS; r++)
+    {
+        for (c = 0; c < 2; c++)
+        {
+            calibrationRanks = c == 0 ? 1 : nProc;
+            if (procId != MASTER)
+            {
+                processSlave();
+                continue;
+            }
+
+            remove(outputFileName);
+            processMaster(CALIBRATION_DIRECTORY);
+            for (t = 0; t < nTests; t++)
+            {
+                if (r == 0 || calibrationNanos[t] < fastest[c][t])
+                    fastest[c][t] = calibrationNanos[t];
+            }
+        }
+    }
+    calibrationRanks = 0;
+
+    if (procId != MASTER)
+        return;
+
+    tuning.count = 0;
+    for (t = 0; t < nTests; t++)
+    {
+        int textLength = calibrationSizes[t / 4 / nPatterns];
+        int patternLength = calibrationPatterns[t / 4 % nPatterns];
+        TuningEntry* entry = setTuning(&tuning, lengthClass(textLength), lengthClass(patternLength), t % 4);
+        if (entry == NULL)
+            continue;
+
+        int alone = fastest[0][t] <= fastest[1][t];
+        entry->ranks = alone ? 1 : nProc;
+        entry->seconds = (double)fastest[alone ? 0 : 1][t] / 1.0e9;
+        printf("text %i pattern %i mode %i: %i ranks, %.09f\n", textLength, patternLength, t % 4, entry->ranks, entry->seconds);
+    }
+
+    if (saveTuning(&tuning, fileName))
+        printf("Tuning profile written to %s\n", fileName);
 }
 
 void main(int argc, char** argv)
 {
 
-    MPI_Init(&argc, &argv);
+    // the loader thread of -prefetch makes no MPI calls
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_size(MPI_COMM_WORLD, &nProc);
     MPI_Comm_rank(MPI_COMM_WORLD, &procId);
 
-    // exit if no input directory specified, or fewer than 4 cores
-    if (argc < 2 || nProc < 4)
+    // exit if fewer than 4 cores
+    if (nProc < 4)
+    {
+        printf("Not enough processes: at least 4 are needed.");
+        exit(0);
+    }
+
+    // the input directory is not needed to calibrate, which reads no inputs
+    char* directory = argc >= 2 && argv[1][0] != '-' ? argv[1] : NULL;
+    int calibrateMode = 0;
+    int resumeMode = 0;
+    int i;
+    for (i = directory != NULL ? 2 : 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-mpiio") == 0)
+            mpiioMode = 1;
+        else if (strcmp(argv[i], "-halo") == 0)
+            haloMode = 1;
+        else if (strcmp(argv[i], "-counters") == 0)
+            countersMode = 1;
+        else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+            profileFileName = argv[++i];
+        else if (strcmp(argv[i], "-prefetch") == 0)
+            prefetchMode = 1;
+        else if (strcmp(argv[i], "-lazy") == 0)
+            lazyMode = 1;
+        else if (strcmp(argv[i], "-calibrate") == 0)
+        {
+            calibrateMode = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                profileFileName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-checkpoint") == 0)
+        {
+            checkpointMode = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                batchLimit = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-resume") == 0 || strcmp(argv[i], "--resume") == 0)
+            resumeMode = checkpointMode = 1;
+        else
+        {
+            if (procId == MASTER)
+                printf("Unknown option %s\n", argv[i]);
+            MPI_Finalize();
+            exit(0);
+        }
+    }
+
+    if (directory == NULL && !calibrateMode)
     {
-        printf("Not enough arguments: No inputs directory provided.");
+        if (procId == MASTER)
+            printf("Not enough arguments: No inputs directory provided.");
+        MPI_Finalize();
         exit(0);
     }
 
+    // the loader thread runs alongside the MPI calls of the master, which needs at least MPI_THREAD_FUNNELED
+    if ((prefetchMode || lazyMode) && provided < MPI_THREAD_FUNNELED)
+    {
+        if (procId == MASTER)
+            printf("-prefetch and -lazy are not used without MPI_THREAD_FUNNELED support\n");
+        prefetchMode = lazyMode = 0;
+    }
+
+    if (countersMode)
+        openCounters(&processCounters);
+
+    // the master writes every result while calibrating
+    if (calibrateMode)
+        mpiioMode = checkpointMode = 0;
+    if (batchLimit < 1 || batchLimit > CONTROL_WINDOW)
+        batchLimit = CONTROL_WINDOW;
+
+    // a resumed run drops any results written after its checkpoint, before the results file is
+    // opened for MPI-IO, and the master skips the tests before it
+    if (checkpointMode)
+    {
+        if (procId == MASTER)
+            resumeTests = startCheckpoints(checkpointFileName, outputFileName, resumeMode);
+        MPI_Bcast(&resumeTests, 1, MPI_LONG, MASTER, MPI_COMM_WORLD);
+        if (resumeTests < 0)
+        {
+            MPI_Finalize();
+            exit(0);
+        }
+    }
+
+    // results are appended to the file, as when the master writes them
+    if (mpiioMode)
+    {
+        if (MPI_File_open(MPI_COMM_WORLD, outputFileName, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &outputFile) != MPI_SUCCESS)
+        {
+            if (procId == MASTER)
+                fprintf(stderr, "could not open file %s\n", outputFileName);
+            MPI_Finalize();
+            exit(0);
+        }
+        MPI_File_get_size(outputFile, &outputOffset);
+    }
+
     // determine which function to run based on process ID
-    if (procId == MASTER)
+    if (calibrateMode)
+    {
+        calibrate(profileFileName);
+    }
+    else if (procId == MASTER)
     {
-        processMaster(argv[1]);
+        processMaster(directory);
     }
     else
     {
         processSlave();
     }
 
+    if (mpiioMode)
+        MPI_File_close(&outputFile);
+    closeCounters(&processCounters);
+
+    reportMemory();
+
     MPI_Finalize();
 
 
@@ -10,22 +10,153 @@
 // control file, and the result of the search is output to a file,
 // result_OMP.txt.
 //
+// The searches are made by the search library (search.h), which
+// divides the start positions of the text into contiguous blocks of
+// several megabytes, extended by patternLength - 1 characters so
+// occurrences across blocks are found once, and every thread runs a
+// sequential search over the blocks it is given.
+//
+// Search modes of a control entry:
+//      0   find any occurrence, writes -2 if found
+//      1   find all occurrences, writes the index of each occurrence
+//      2   count occurrences, writes the number of occurrences
+//      3   find the first N occurrences in text order, writes the index of
+//          each. N is the fourth value of the control entry, "3 text pattern N",
+//          and defaults to 1
+// All modes write -1 when the pattern does not occur, except mode 2
+// which writes a count of 0. An entry "mode text pattern limit start end"
+// only finds occurrences within characters start to end - 1 of the text
+// (control.h), which are the only positions divided among the threads,
+// and writes their locations in the whole text.
+//
+// The control file is read as the tests run (control.h), up to
+// CONTROL_WINDOW entries at a time, so a control file of any length runs
+// in constant memory. The entries read together are run grouped by text
+// and then by pattern, so a text is searched by consecutive tests while
+// it is in cache, and their results are written in control order once
+// all of them have run.
+//
+// When a test of mode 1 or 2 is reached, every test of mode 1 or 2 of
+// the same entries not yet run which searches the same text for a pattern of the same length is
+// answered with it by one Rabin-Karp search for all of their patterns
+// (searchTeamMulti). Their results are kept and written when each test
+// is reached, so the output is unchanged. The run report attributes the
+// shared search to the first test of the group, and lists tests in the
+// order they ran.
+//
+// Texts and patterns with the same contents share one buffer, as do a
+// file and a prefix of it (content.h), and are grouped as one when the
+// tests are ordered. A test of the same search as one already run, such
+// as a pattern identical to another, copies that test's results rather
+// than searching again.
+//
+// The block size and number of searching threads of each test are
+// those of its bucket of the tuning profile (tuning.h), when one has been
+// written by -calibrate, and otherwise the defaults of the search library.
+//
+// Usage: project_OMP <directory> [-threads n] [-counters] [-numa] [-interleave n] [-packed] [-server [path]]
+//                    [-profile file] [-calibrate [file]] [-prefetch] [-lazy] [-checkpoint [n]] [-resume]
+//        project_OMP -calibrate [file] [-threads n]
+//      -threads n      number of threads searching (default 4, or the most
+//                      threads any bucket of the tuning profile uses)
+//      -counters       reads the hardware counters of every thread around
+//                      each test and adds them to the run report, with IPC
+//                      and bytes scanned per cycle (counters.h)
+//      -numa           pins each thread to a CPU, first touches every text in
+//                      parallel using the block partition of the searches so
+//                      each block is local to the thread that searches it, and
+//                      reports the bandwidth of each socket
+//      -interleave n   with -numa, texts of at least n characters are
+//                      interleaved across every NUMA node instead (requires
+//                      building with -DNUMA -lnuma)
+//      -packed         stores each text of at most 16 distinct characters in
+//                      2 or 4 bits per character once it is read, and searches
+//                      it comparing many characters at once. Other texts are
+//                      kept and searched as before, and packed texts are not
+//                      placed by -numa
+//      -server [path]  keeps the texts and patterns in memory and answers
+//                      queries from stdin, or from clients of a Unix domain
+//                      socket created at path, instead of running the control
+//                      file. The protocol is described in server.h. "ready" is
+//                      written to stdout once the server accepts queries
+//      -profile file   the tuning profile to load (default tuning_OMP.txt,
+//                      not used with -numa, where blocks must stay with the
+//                      threads which placed them)
+//      -calibrate [file]
+//                      times every candidate block size and number of
+//                      searching threads on synthetic texts for each bucket,
+//                      and writes the fastest to the tuning profile (default
+//                      tuning_OMP.txt), instead of running the control file.
+//                      The directory is not read and may be left out, as in
+//                      "project_OMP -calibrate", and the team has a thread
+//                      per CPU unless -threads is given
+//      -prefetch       reads the texts and patterns on a loader thread in
+//                      the order the control file names them (loader.h),
+//                      while the tests run on those already read, so each
+//                      test waits only for its own files
+//      -lazy           reads only the texts and patterns the control file
+//                      names, when a test first needs them or ahead of the
+//                      tests with -prefetch, and frees each once the last
+//                      test naming it has run (loader.h)
+//      -checkpoint [n] writes a checkpoint to checkpoint_OMP.txt each time
+//                      the results of a window are written (checkpoint.h),
+//                      with windows of at most n tests (default 1024)
+//      -resume         truncates result_OMP.txt to the length recorded by the
+//                      checkpoint and continues after its last test, or
+//                      empties it and starts from the first test if there is
+//                      no checkpoint. Implies -checkpoint
+// With -prefetch or -lazy, files are not shared by contents, and -numa,
+// -packed and -server, which need every text first, read every file
+// before the tests as before.
+//
 /////////////////////////////////////////////////////////////////////
 
+#ifdef __linux__
+#define _GNU_SOURCE // CPU affinity, used by placement.h, and syscall, used by counters.h
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 #include <dirent.h>
+#include <limits.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num() 0
+#define omp_get_num_threads() 1
+#define omp_get_num_procs() 1
+#endif
+
+#include "checkpoint.h"
+#include "content.h"
+#include "control.h"
+#include "counters.h"
+#include "loader.h"
+#include "metrics.h"
+#include "placement.h"
+#include "search.h"
+#include "server.h"
+#include "synthetic.h"
+#include "tuning.h"
 
 #define MAX_TEXTS 20
 #define MAX_PATTERNS 20 // based on assumptions from assignment brief
 
-#define MAX_TESTS 1024
+// control entries read and run together
+#define CONTROL_WINDOW 1024
 
-#define BYTES_PER_LINE 20 // 4 bytes per character * 5 characters
-#define BUFFER_SIZE 2000
+// fewest tests answered together by one multi-pattern search
+#define MULTI_PATTERN_MIN 2
+
+// calibration: runs of each configuration, the fastest of which is kept, occurrences found by
+// search mode 3, and copies of each pattern planted per million characters
+#define CALIBRATION_REPEATS 3
+#define CALIBRATION_LIMIT 10
+#define CALIBRATION_MATCHES 10.0
 
 char *textData[MAX_TEXTS];
 int textLengths[MAX_TEXTS];
@@ -35,16 +166,131 @@ char *patternData[MAX_PATTERNS];
 int patternLengths[MAX_PATTERNS];
 int patternCount;
 
-char controlData[MAX_TESTS][3];
+// the content ID of each text and pattern, and the text whose buffer each text shares
+int textIds[MAX_TEXTS];
+int textOwners[MAX_TEXTS];
+int patternIds[MAX_PATTERNS];
+
+// the control file, and the entries read from it which are being run. Test windowStart + slot
+// is held in slot of every array indexed by slot
+ControlReader control;
+ControlEntry controlWindow[CONTROL_WINDOW];
+int windowStart; // the test in slot 0
+int windowCount; // tests read and not yet written
+int windowLimit = CONTROL_WINDOW; // tests read into a window, fewer to write checkpoints more often
+int controlEnded; // whether every entry has been read
+
+// the order the tests of the window run in, whether each has run, and the results of each
+int runOrder[CONTROL_WINDOW];
+char testRun[CONTROL_WINDOW];
+TestOutput testOutputs[CONTROL_WINDOW];
+
+// the result of each test of the window, and the test of the same search whose results the
+// current test copies, or -1
+int testFound[CONTROL_WINDOW];
+int copyFrom;
 
 char* directory;
 
+// number of threads used by the searches, and the file results are appended to
+int numThreads = 4;
+char* outputFileName = "result_OMP.txt";
+
+// whether a checkpoint is written after each window, and the file it is written to
+int checkpointMode = 0;
+char* checkpointFileName = "checkpoint_OMP.txt";
+
+// state of the searches made by the team, and instrumentation of the last search
+SearchContext* searchContext;
+SearchStats searchStats;
+
+// the tuning profile, whose buckets set the block size and searching threads of each test, and
+// the file it is read from and written to by -calibrate
+TuningProfile tuning;
+char* profileFileName = "tuning_OMP.txt";
+
+// text lengths, pattern lengths and block sizes timed by -calibrate
+const int calibrationSizes[] = { 65536, 262144, 1048576, 4194304, 16777216 };
+const int calibrationPatterns[] = { 4, 16, 64 };
+const int calibrationBlocks[] = { 65536, 262144, 1048576, 4194304 };
+
+// whether texts are placed and threads pinned for NUMA systems, and the text length from which
+// texts are interleaved across every node rather than placed by first touch, 0 to never interleave
+int numaMode = 0;
+long interleaveSize = 0;
+
+// the socket each thread runs on, and the text scanned and time spent searching by each thread
+// over the whole run, used to report the bandwidth of each socket
+int threadSocket[MAX_WORKERS];
+long threadBytes[MAX_WORKERS];
+long threadBusy[MAX_WORKERS];
+
+// characters of text first touched by threads on each socket, or interleaved across every socket
+long socketPlaced[MAX_SOCKETS];
+long interleavedPlaced;
+
+// text being placed, shared by the team while it is copied
+char* placedText;
+
+// whether hardware counters are read around each test, and the counters of each thread
+int countersMode = 0;
+Counters threadCounters[MAX_WORKERS];
+
+// whether texts with small alphabets are packed, and the packed form of each text, or NULL
+// when the text is stored a character per byte in textData
+int packedMode = 0;
+SearchPacked* packedTexts[MAX_TEXTS];
+
+// tests answered ahead of their turn by a multi-pattern search, with their locations and counts
+char answeredAhead[CONTROL_WINDOW];
+SearchResults aheadResults[CONTROL_WINDOW];
+int aheadCounts[CONTROL_WINDOW];
+
+// the group of tests being answered by a multi-pattern search, indexed by position in the group
+int groupTests[CONTROL_WINDOW];
+const char* groupPatterns[CONTROL_WINDOW];
+SearchResults groupResults[CONTROL_WINDOW];
+int groupCounts[CONTROL_WINDOW];
+int groupSize;
+
+// the batch of queries being answered in server mode, and the order they are searched in
+Query batch[MAX_BATCH];
+int batchOrder[MAX_BATCH];
+int batchCount;
+
+// whether files are read by a loader thread as the tests run, whether only files named by the
+// control file are read and each is freed after its last test, and whether files are read by the
+// loader for either
+int prefetchMode = 0;
+int lazyMode = 0;
+int loaderMode = 0;
+Loader loader;
+
+// time taken to read each file, used to attribute load time to tests
+long textLoadNanos[MAX_TEXTS];
+long patternLoadNanos[MAX_PATTERNS];
+
+// instrumentation of the test currently running, written to the run report after each test
+TestMetrics metrics;
+char* reportFileName = "metrics_OMP.csv";
+
 void outOfMemory()
 {
     fprintf (stderr, "Out of memory\n");
     exit (0);
 }
 
+/// <summary>
+/// Gets the current time in nanoseconds.
+/// </summary
+/// <returns>The time in nanoseconds.</returns>
+long getNanos()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 void readFromFile (FILE *f, char **data, int *length)
 {
     int ch;
@@ -84,357 +330,1023 @@ void readFromFile (FILE *f, char **data, int *length)
 /// <param name="filename">The Filename to identify which files to read.</param>
 /// <param name="data">The Character Array to store the read data.</param>
 /// <param name="lengths">The Integer Array to store the lengths of the files.</param>
+/// <param name="loadNanos">Array to store the time taken to read each file.</param>
 /// <returns>The number of files read.</returns>
-int readFiles(const int maxFiles, char* filename, char *data[], int lengths[])
+int readFiles(const int maxFiles, char* filename, char *data[], int lengths[], long loadNanos[])
 {
     int count = 0;
+    int number;
     FILE *f;
     char fileName[1000];
-    for (count; count < maxFiles; count++)
+    for (number = 0; number < maxFiles; number++)
     {
 #ifdef DOS
-        sprintf (fileName, "%s\\%s%i.txt", directory, filename, count);
+        sprintf (fileName, "%s\\%s%i.txt", directory, filename, number);
 #else
-        sprintf (fileName, "%s/%s%i.txt", directory, filename, count);
+        sprintf (fileName, "%s/%s%i.txt", directory, filename, number);
 #endif
 
+        long time = getNanos();
         f = fopen(fileName, "r");
+
+        // a missing file is left empty, and the files after it are still read
         if (f == NULL)
-            return 0;
+            continue;
 
-        readFromFile(f, &data[count], &lengths[count]);
-        printf("read %s %i\n", filename, count);
+        readFromFile(f, &data[number], &lengths[number]);
+        printf("read %s %i\n", filename, number);
         fclose(f);
-
+        loadNanos[number] = getNanos() - time;
+        count++;
     }
     return count;
 }
 
 /// <summary>
-/// Read the test cases from the control file in the input directory, and load them into an array.
+/// Reads up to windowLimit control entries into the window, and orders them to be run grouped
+/// by text and then pattern. Called by a single thread once the previous window is written.
 /// </summary>
-/// <returns>The number of tests in the control file.</returns>
-int readControl()
+void fillWindow()
 {
-    FILE *f;
-    char fileName[1000];
-
-#ifdef DOS
-    sprintf (fileName, "%s\\control.txt", directory);
-#else
-    sprintf (fileName, "%s/control.txt", directory);
-#endif
-
-    f = fopen(fileName, "r");
-    if (f == NULL)
-        return 0;
-
-    int testCount = 0;
-    int readResult;
-
-    while ((readResult = fscanf(f, "%i %i %i", &controlData[testCount][0], &controlData[testCount][1], &controlData[testCount][2])) != EOF)
+    ControlEntry entry;
+    while (windowCount < windowLimit && !controlEnded)
     {
-        if (readResult == 3)
-        {
-            printf("Read control entry %i\n", testCount);
-            printf("%i %i %i\n\n", controlData[testCount][0], controlData[testCount][1], controlData[testCount][2]);
-            testCount++;
-        }
-        else
+        if (!nextControlEntry(&control, &entry))
         {
             printf("End of Control File reached.\n\n");
+            controlEnded = 1;
+            break;
         }
+
+        controlWindow[windowCount] = entry;
+        answeredAhead[windowCount] = 0;
+        testRun[windowCount] = 0;
+
+        printf("Read control entry %i\n", windowStart + windowCount);
+        printf("%i %i %i\n\n", entry.mode, entry.textNumber, entry.patternNumber);
+        windowCount++;
     }
-    fclose(f);
 
-    return testCount;
+    orderControl(controlWindow, windowCount, textIds, patternIds, runOrder);
 }
 
 /// <summary>
-/// Writes the contents of a character buffer to file.
+/// Finds a test of the same search as a test which has already run. Tests of the same search
+/// are run one after another, after any other test of the same text and pattern contents.
 /// </summary>
-/// <param name="buffer">The character buffer to be written to file.</param>
-void writeBufferToOutput(char buffer[])
+/// <param name="k">The position of the test in the run order.</param>
+/// <returns>The slot of the test to copy the results of, or -1.</returns>
+int findSameSearch(int k)
 {
-    FILE* f;
-    char fileName[1000];
-
-    sprintf(fileName, "result_OMP.txt");
-
-    f = fopen(fileName, "a+");
-    if (f == NULL)
+    ControlEntry* test = &controlWindow[runOrder[k]];
+    int j;
+    for (j = k - 1; j >= 0; j--)
     {
-        fprintf(stderr, "writeBufferToOutput: could not open file %s", fileName);
-        return;
+        ControlEntry* other = &controlWindow[runOrder[j]];
+        if (textIds[other->textNumber] != textIds[test->textNumber] ||
+            patternIds[other->patternNumber] != patternIds[test->patternNumber])
+            break;
+        if (sameSearch(other, test, textIds, patternIds))
+            return runOrder[j];
     }
-    fprintf(f, buffer);
-    fclose(f);
-
-    // clear buffer
-    buffer[0] = '\0';
+    return -1;
 }
 
+// where writeLocation writes the locations delivered by a search
+typedef struct
+{
+    TestOutput* output;
+    int textNumber;
+    int patternNumber;
+} OutputTarget;
+
 /// <summary>
-/// Writes a test result to the buffer.
+/// Writes a location delivered by a search to the output of a test.
 /// </summary>
-/// <param name="buffer">Character buffer to be written to.</param>
-/// <param name="textNumber">The Text number specified by the test case.</param>
-/// <param name="patternNumber">The Pattern number specified by the test case.</param>
-/// <param name="patternLocation">The location in the text the pattern was found.</param>
-void writeToBuffer(char buffer[], int textNumber, int patternNumber, int patternLocation)
+/// <param name="target">The OutputTarget to write to.</param>
+/// <param name="location">The location the pattern was found.</param>
+void writeLocation(void* target, int location)
 {
-    // write full buffer to output and clear
-    if (strlen(buffer) > BUFFER_SIZE - BYTES_PER_LINE)
-    {
-        writeBufferToOutput(buffer);
-    }
-    // append new result to buffer
-    sprintf(buffer + strlen(buffer), "%i %i %i\n", textNumber, patternNumber, patternLocation);
+    OutputTarget* t = (OutputTarget*)target;
+    appendOutput(t->output, t->textNumber, t->patternNumber, location);
 }
 
 /// <summary>
-/// Parallel searching algorithm which searches for any instance of a pattern
-/// and completes after successfully finding the pattern.
+/// Pins the team for NUMA systems and moves every text into memory first touched by the threads
+/// which will search it, called by every thread of the team before the tests are run. Each text
+/// is copied into fresh memory block by block, with the same partition the searches use, and the
+/// searches keep each block on the thread which placed it, so the pages of a block are allocated
+/// on the socket of the thread searching it. The partition is taken over every character of the text rather than the start positions
+/// of a particular pattern. Placed searches count their blocks from the length of the text too, so they have the same blocks,
+/// whose boundaries differ from these by at most patternLength - 1 characters.
 /// </summary>
-/// <param name="textNumber">The Text number specified by the test case.</param>
-/// <param name="patternNumber">The Pattern number specified by the test case.</param>
-/// <param name="buffer">The Buffer to write the result to.</param>
-void findOccurrence(int textNumber, int patternNumber, char buffer[])
+void placeTexts()
 {
+    int thread = omp_get_thread_num();
+    int t, b;
 
-    // load data
-    char *text = textData[textNumber];
-    int textLength = textLengths[textNumber];
-
-    char *pattern = patternData[patternNumber];
-    int patternLength = patternLengths[patternNumber];
+    // threads placed by OMP_PLACES or OMP_PROC_BIND are left where they are
+#ifdef _OPENMP
+    if (omp_get_proc_bind() == omp_proc_bind_false)
+#endif
+        pinThread(thread, omp_get_num_threads());
+    threadSocket[thread] = currentSocket();
 
-    int i, j, k, lastI, stopSearch;
-    i=0;
-    j=0;
-    k=0;
+    // every text slot is checked, since texts may be missing between those read
+    for (t = 0; t < MAX_TEXTS; t++)
+    {
+        // a text sharing the buffer of another is placed with it
+        int length = textLengths[t];
+        if (textData[t] == NULL || length == 0 || textOwners[t] != t)
+            continue;
 
-    // last index in text to search from
-    lastI = textLength-patternLength;
+        int nBlocks = searchBlockCount(searchContext, length, omp_get_num_threads());
+        int interleaved = 0;
 
-    // -1 denotes pattern not found
-    int patternLoc = -1;
+        #pragma omp single
+        {
+            // page aligned, since memory is placed a page at a time
+            if (posix_memalign((void**)&placedText, PAGE_SIZE, length * sizeof(char)) != 0)
+                outOfMemory();
+        }
 
-    // sharing pattern location since all threads depend on it to stop searching
-    #pragma omp parallel for default(none) shared(patternLoc, buffer) \
-    private(j, k) firstprivate(text, textLength, pattern, patternLength, lastI, textNumber, patternNumber) \
-    num_threads(4) schedule(static,4)
-    for (i = 0; i <= lastI; i++)
-    {
-        // pattern is already found, stop searching
-        if (patternLoc >= 0)
+        if (interleaveSize > 0 && length >= interleaveSize)
         {
-            continue;
+            #pragma omp single
+            {
+                if (interleaveMemory(placedText, length))
+                    interleavedPlaced += length;
+                else
+                    printf("Cannot interleave text %i, build with -DNUMA -lnuma\n", t);
+            }
+            interleaved = 1;
         }
-        else
+
+        #pragma omp for schedule(static,1)
+        for (b = 0; b < nBlocks; b++)
         {
-            k = i;
-            j = 0;
+            int first = searchBlockStart(b, nBlocks, length);
+            int last = searchBlockStart(b + 1, nBlocks, length);
+            memcpy(placedText + first, textData[t] + first, last - first);
 
-            // stop searching if we find the pattern, or if it has been found by another thread
-            while (j < patternLength && patternLoc == -1)
+            if (!interleaved)
             {
-                if (text[k] == pattern[j])
-                {
-                    k++;
-                    j++;
-                }
-                else // no longer matching, break out
-                {
-                    break;
-                }
+                #pragma omp atomic
+                socketPlaced[threadSocket[thread]] += last - first;
             }
+        }
 
-            if (j == patternLength)
+        #pragma omp single
+        {
+            int s;
+            free(textData[t]);
+            for (s = 0; s < MAX_TEXTS; s++)
             {
-                // prevents multiple threads writing at the same time
-                // since the condition within will be set at first pattern instance
-                // so other threads waiting to check will not write
-                #pragma omp critical(set)
-                {
-                    if (patternLoc == -1)
-                    {
-                        patternLoc = i;
-                        // write -2 to denote pattern is found
-                        //printf("Pattern found at %i\n", i);
-                        writeToBuffer(buffer, textNumber, patternNumber, -2);
-                    }
-                }
+                if (textOwners[s] == t && textData[s] != NULL)
+                    textData[s] = placedText;
             }
+        }
+    }
+}
+
+/// <summary>
+/// Packs every text with at most 16 distinct characters, freeing the text it was read into so
+/// only the packed form is kept. Texts with the same contents share one packed form, and a
+/// buffer shared by several texts is freed once every one of them is packed.
+/// </summary>
+void packTexts()
+{
+    int t, s;
+    for (t = 0; t < MAX_TEXTS; t++)
+    {
+        if (textData[t] == NULL)
+            continue;
 
+        if (textIds[t] != t)
+        {
+            packedTexts[t] = packedTexts[textIds[t]];
+            continue;
         }
+
+        packedTexts[t] = searchPack(textData[t], textLengths[t]);
+        if (packedTexts[t] != NULL)
+            printf("packed text %i %i bytes into %li\n", t, textLengths[t], searchPackedBytes(packedTexts[t]));
     }
 
-    // report pattern as not found
-    if (patternLoc == -1)
+    for (t = 0; t < MAX_TEXTS; t++)
     {
-        writeToBuffer(buffer, textNumber, patternNumber, -1);
+        if (textData[t] == NULL || textOwners[t] != t)
+            continue;
+
+        int packed = 1;
+        for (s = 0; s < MAX_TEXTS; s++)
+        {
+            if (textOwners[s] == t && textData[s] != NULL && packedTexts[s] == NULL)
+                packed = 0;
+        }
+        if (!packed)
+            continue;
+
+        free(textData[t]);
+        for (s = 0; s < MAX_TEXTS; s++)
+        {
+            if (textOwners[s] == t)
+                textData[s] = NULL;
+        }
     }
+}
 
+/// <summary>
+/// Copies the instrumentation of the last search into the metrics of the current test, and
+/// accumulates the text scanned and time spent searching by each thread over the run.
+/// </summary>
+void recordSearchStats()
+{
+    int t;
+    metrics.bytesScanned = searchStats.positions;
+    metrics.comparisons = searchStats.comparisons;
+    metrics.workers = searchStats.workers;
+    for (t = 0; t < searchStats.workers; t++)
+    {
+        metrics.busyNanos[t] = searchStats.busyNanos[t];
+        threadBytes[t] += searchStats.workerPositions[t];
+        threadBusy[t] += searchStats.busyNanos[t];
+    }
 }
 
 /// <summary>
-/// Parallel searching algorithm which searches for all instances of a pattern
-/// and completes only after searching the entire text.
+/// Sets the block size and number of searching threads of a search to those of its bucket of the
+/// tuning profile, or to the defaults of the search library when there is none. Called by a single thread.
 /// </summary>
-/// <param name="textNumber">The Text number specified by the test case.</param>
-/// <param name="patternNumber">The Pattern number specified by the test case.</param>
-/// <param name="buffer">The Buffer to write the result to.</param>
-void findAllOccurrences(int textNumber, int patternNumber, char buffer[])
+/// <param name="searchType">The search mode.</param>
+/// <param name="textLength">The length of the range of the text searched.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+void tuneSearch(int searchType, int textLength, int patternLength)
 {
-    // load text and pattern data
-    char *text = textData[textNumber];
-    int textLength = textLengths[textNumber];
+    // placed blocks must keep the partition they were placed with
+    TuningEntry* entry = numaMode ? NULL : findTuning(&tuning, textLength, patternLength, searchType);
 
-    char *pattern = patternData[patternNumber];
-    int patternLength = patternLengths[patternNumber];
+    searchSetBlockSize(searchContext, entry != NULL ? entry->blockSize : 0);
+    searchSetThreads(searchContext, entry != NULL && entry->threads < numThreads ? entry->threads : 0);
+}
 
-    int i, j, k, lastI;
-    i=0;
-    j=0;
-    k=0;
+/// <summary>
+/// Searches a text for a pattern and writes the result of the search mode, called by every thread
+/// of the team. Locations are written as the search delivers them.
+/// </summary>
+/// <param name="searchType">The search mode.</param>
+/// <param name="textNumber">The number of the text to search, which is searched packed if it was packed.</param>
+/// <param name="start">The first character of the range of the text searched.</param>
+/// <param name="end">One past the last character of the range, or -1 for the end of the text.</param>
+/// <param name="pattern">The pattern to search for.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="limit">The number of occurrences to find in search mode 3.</param>
+/// <param name="write">Called with each result to write.</param>
+/// <param name="target">Passed to write.</param>
+/// <returns>The result of the search.</returns>
+int writeSearch(int searchType, int textNumber, int start, int end, char* pattern, int patternLength, int limit,
+    SearchCallback write, void* target)
+{
+    SearchResults results = { NULL, 0, 0, 0, write, target };
+    int found;
 
-    // last index in text to search from
-    lastI = textLength-patternLength;
+    #pragma omp single
+    {
+        int textLength = packedTexts[textNumber] != NULL ? searchPackedLength(packedTexts[textNumber]) :
+            textLengths[textNumber];
+        if (end >= 0 && end < textLength)
+            textLength = end;
 
-    // -1 denotes pattern not found
-    int patternLoc = -1;
+        searchSetRange(searchContext, start, end);
+        tuneSearch(searchType, start < textLength ? textLength - start : 0, patternLength);
+    }
 
-    // sharing the buffer was simpler than using private buffers and writing to file once buffer limits were reached
-    // although patternLoc doesn't need to be shared here, I observed that it was quicker than using reduction
-    // dynamic scheduling was chosen as it yielded lower elapsed cpu runtimes on average
-    // also since I won't know in advance the large inputs, dynamic is often more useful for imbalanced workloads
+    if (packedTexts[textNumber] != NULL)
+        found = searchTeamPacked(searchContext, searchType, packedTexts[textNumber], pattern, patternLength, limit,
+            &results, &searchStats);
+    else
+        found = searchTeam(searchContext, searchType, textData[textNumber], textLengths[textNumber], pattern,
+            patternLength, limit, &results, &searchStats);
 
-    #pragma omp parallel for default(none) shared(buffer, patternLoc) \
-    private(j, k) firstprivate(text, textLength, pattern, patternLength, lastI, textNumber, patternNumber) \
-    num_threads(4) schedule(dynamic,4)
-    for (i = 0; i <= lastI; i++)
+    #pragma omp single
     {
-        k = i;
-        j = 0;
+        if (searchType == 0) // find any occurrence, write -2 to denote pattern is found
+            write(target, found ? -2 : -1);
+        else if (searchType == 2) // count occurrences, including 0
+            write(target, found);
+        else if (found == 0) // report pattern as unfound
+            write(target, -1);
+    }
+    return found;
+}
+
+/// <summary>
+/// Runs a searching algorithm on the specified text/pattern combination, called by every thread of the team.
+/// </summary>
+/// <param name="searchType">The search mode.</param>
+/// <param name="textNumber">The number of the text to search.</param>
+/// <param name="patternNumber">The number of the pattern to search for.</param>
+/// <param name="limit">The number of occurrences to find in search mode 3.</param>
+/// <param name="start">The first character of the range of the text searched.</param>
+/// <param name="end">One past the last character of the range, or -1 for the end of the text.</param>
+/// <param name="output">The output to write the results to.</param>
+/// <returns>The result of the search.</returns>
+int runTest(int searchType, int textNumber, int patternNumber, int limit, int start, int end, TestOutput* output)
+{
+    OutputTarget target = { output, textNumber, patternNumber };
+
+    return writeSearch(searchType, textNumber, start, end, patternData[patternNumber], patternLengths[patternNumber],
+        limit, writeLocation, &target);
+}
 
-        // since the pattern can be found in the middle of the loop
-        // we check if pattern is found every loop to stop making comparisons as soon as possible.
-        while (j < patternLength && text[k] == pattern[j])
+/// <summary>
+/// Finds the tests to answer with a multi-pattern search when a test is reached: the test and
+/// every other test of the window of mode 1 or 2 which has not run or been answered, and which
+/// searches the same range of a text of the same contents, stored a character per byte, for a
+/// pattern of the same length.
+/// Called by a single thread.
+/// </summary>
+/// <param name="slot">The slot of the test reached.</param>
+/// <returns>The number of tests in the group, or 0 if the test is searched on its own.</returns>
+int findGroup(int slot)
+{
+    ControlEntry* test = &controlWindow[slot];
+    int patternLength = patternLengths[test->patternNumber];
+    int j;
+
+    groupSize = 0;
+    if (answeredAhead[slot] || (test->mode != 1 && test->mode != 2) ||
+        textData[test->textNumber] == NULL || patternLength < 1)
+        return 0;
+
+    for (j = 0; j < windowCount; j++)
+    {
+        ControlEntry* other = &controlWindow[j];
+        int patternNumber = other->patternNumber;
+        if ((other->mode == 1 || other->mode == 2) && textIds[other->textNumber] == textIds[test->textNumber] &&
+            other->start == test->start && other->end == test->end &&
+            !testRun[j] && !answeredAhead[j] && (!loaderMode || fileLoaded(&loader, &loader.patterns, patternNumber)) &&
+            patternData[patternNumber] != NULL &&
+            patternLengths[patternNumber] == patternLength)
         {
-            k++;
-            j++;
+            groupTests[groupSize] = j;
+            groupPatterns[groupSize] = patternData[patternNumber];
+
+            // only the locations of mode 1 are kept, mode 2 needs only the count
+            SearchResults results = { NULL, 0, other->mode == 1, 0, NULL, NULL };
+            groupResults[groupSize] = results;
+            groupSize++;
         }
-        
-        if (j == patternLength)
+    }
+
+    if (groupSize < MULTI_PATTERN_MIN)
+        groupSize = 0;
+    return groupSize;
+}
+
+/// <summary>
+/// Answers a test, and every later test grouped with it, with one multi-pattern search if it
+/// starts a group. Called by every thread of the team.
+/// </summary>
+/// <param name="slot">The slot of the test reached.</param>
+void answerGroup(int slot)
+{
+    int g;
+
+    #pragma omp single
+    {
+        // the group is searched with the configuration of its first test
+        if (findGroup(slot) > 0)
         {
-            // allow only one thread at a time to write to buffer
-            #pragma omp critical(set)
-            {
-                //printf("Pattern found at %i\n", i);
-                writeToBuffer(buffer, textNumber, patternNumber, i);
-                patternLoc = 1;
-            }
+            ControlEntry* test = &controlWindow[slot];
+            int start, end;
+            controlRange(test, textLengths[test->textNumber], &start, &end);
+
+            searchSetRange(searchContext, test->start, test->end);
+            tuneSearch(test->mode, end - start, patternLengths[test->patternNumber]);
         }
     }
 
-    // report pattern as unfound
-    if (patternLoc == -1)
+    if (groupSize == 0)
+        return;
+
+    int textNumber = controlWindow[slot].textNumber;
+    searchTeamMulti(searchContext, textData[textNumber], textLengths[textNumber], groupPatterns, groupSize,
+        patternLengths[controlWindow[slot].patternNumber], groupResults, groupCounts, &searchStats);
+
+    #pragma omp single
     {
-        writeToBuffer(buffer, textNumber, patternNumber, -1);
+        for (g = 0; g < groupSize; g++)
+        {
+            answeredAhead[groupTests[g]] = 1;
+            aheadResults[groupTests[g]] = groupResults[g];
+            aheadCounts[groupTests[g]] = groupCounts[g];
+        }
     }
+}
 
+/// <summary>
+/// Writes the result of a test answered ahead of its turn, as runTest would have, and frees its
+/// locations. Called by every thread of the team.
+/// </summary>
+/// <param name="slot">The slot of the test.</param>
+/// <returns>The result of the search.</returns>
+int writeAnswered(int slot)
+{
+    #pragma omp single
+    {
+        ControlEntry* test = &controlWindow[slot];
+        TestOutput* output = &testOutputs[slot];
+        int found = aheadCounts[slot];
+        int r;
+
+        if (test->mode == 2) // count occurrences, including 0
+            appendOutput(output, test->textNumber, test->patternNumber, found);
+        else if (found == 0) // report pattern as unfound
+            appendOutput(output, test->textNumber, test->patternNumber, -1);
+        else
+        {
+            for (r = 0; r < aheadResults[slot].stored; r++)
+            {
+                appendOutput(output, test->textNumber, test->patternNumber, aheadResults[slot].locations[r]);
+            }
+        }
+        free(aheadResults[slot].locations);
+        aheadResults[slot].locations = NULL;
+    }
+    return aheadCounts[slot];
 }
 
+/// <summary>
+/// Checks that a query names a text and pattern which were read.
+/// </summary>
+/// <param name="query">The query to check, whose error is set if it cannot be answered.</param>
+void validateQuery(Query* query)
+{
+    if (query->error != NULL)
+        return;
+
+    if (query->textNumber < 0 || query->textNumber >= MAX_TEXTS ||
+        (textData[query->textNumber] == NULL && packedTexts[query->textNumber] == NULL))
+        query->error = "unknown text";
+    else if (query->patternNumber >= MAX_PATTERNS ||
+        (query->patternNumber >= 0 && patternData[query->patternNumber] == NULL))
+        query->error = "unknown pattern";
+}
 
 /// <summary>
-/// Runs a searching algorithm on the specified text/pattern combination.
+/// Reads the next batch of queries in server mode, accepting a new client of the socket whenever
+/// the current client closes. Called by a single thread.
 /// </summary>
-/// <param name="searchType">Search mode used to determine which searching algorithm to use.</param>
-/// <param name="textNumber">The Text number specified by the test case.</param>
-/// <param name="patternNumber">The Pattern number specified by the test case.</param>
-/// <param name="buffer">The buffer to write the results to.</param>
-void runTest(int searchType, int textNumber, int patternNumber, char buffer[])
+/// <param name="input">The input of the current client.</param>
+/// <param name="listener">The listening socket, or -1 when serving stdin.</param>
+/// <returns>The number of queries read, or -1 once there are no more queries.</returns>
+int nextBatch(ServerInput* input, int listener)
 {
-    // if pattern is larger than text, write result as pattern not found
-    if (textLengths[textNumber] < patternLengths[patternNumber])
+    int q;
+    while (1)
     {
-        writeToBuffer(buffer, textNumber, patternNumber, -1);
-        return;
+#ifndef DOS
+        if (listener >= 0 && input->fd < 0)
+        {
+            input->fd = accept(listener, NULL, NULL);
+            input->start = input->end = input->eof = 0;
+            if (input->fd < 0)
+                return -1;
+        }
+#endif
+
+        int count = readBatch(input, batch);
+        if (count >= 0)
+        {
+            for (q = 0; q < count; q++)
+            {
+                validateQuery(&batch[q]);
+            }
+            orderBatch(batch, count, batchOrder);
+            return count;
+        }
+
+        // the client has closed
+        if (listener < 0)
+            return -1;
+#ifndef DOS
+        close(input->fd);
+#endif
+        input->fd = -1;
     }
+}
+
+/// <summary>
+/// Server mode: answers queries against the texts and patterns already in memory until stdin
+/// closes, or forever when listening on a socket. One team of threads answers every query.
+/// </summary>
+/// <param name="socketPath">The path of the Unix domain socket, or NULL to serve stdin.</param>
+void serve(char* socketPath)
+{
+    int listener = -1;
+    ServerInput* input = (ServerInput*)calloc(1, sizeof(ServerInput));
+    if (input == NULL)
+        outOfMemory();
 
-    if (searchType == 0) // find any occurrence
+    if (socketPath != NULL)
     {
-        //printf("Searching for pattern occurrence\n");
-        findOccurrence(textNumber, patternNumber, buffer);
+        listener = openListener(socketPath);
+        if (listener < 0)
+            exit(0);
+        input->fd = -1;
     }
-    else // find all occurrences
+
+    printf("ready\n");
+    fflush(stdout);
+
+    #pragma omp parallel default(shared) num_threads(numThreads)
     {
-        //printf("Searching for all pattern occurrences\n");
-        findAllOccurrences(textNumber, patternNumber, buffer);
-    }
+        if (numaMode)
+            placeTexts();
 
+        while (1)
+        {
+            #pragma omp single
+            batchCount = nextBatch(input, listener);
+
+            if (batchCount < 0)
+                break;
+
+            // queries are searched grouped by text, and answered in the order they arrived
+            int q;
+            for (q = 0; q < batchCount; q++)
+            {
+                Query* query = &batch[batchOrder[q]];
+                if (query->error != NULL)
+                    continue;
+
+                char* pattern = query->pattern;
+                int patternLength = query->patternLength;
+                if (query->patternNumber >= 0)
+                {
+                    pattern = patternData[query->patternNumber];
+                    patternLength = patternLengths[query->patternNumber];
+                }
 
+                OutputTarget target = { &query->output, query->textNumber, query->patternNumber };
+                writeSearch(query->mode, query->textNumber, 0, -1, pattern, patternLength, query->limit,
+                    writeLocation, &target);
+            }
+
+            #pragma omp single
+            writeAnswers(listener >= 0 ? input->fd : 1, batch, batchCount);
+        }
+    }
 
+    free(input);
 }
 
 /// <summary>
-/// Gets the current time in nanoseconds.
-/// </summary
-/// <returns>The time in nanoseconds.</returns>
-long getNanos()
+/// Discards a location found while calibrating.
+/// </summary>
+void discardLocation(void* target, int location)
 {
-    struct timespec ts;
-    timespec_get(&ts, TIME_UTC);
-    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
 }
 
+/// <summary>
+/// Calibration mode: times every candidate block size and number of searching threads on a
+/// synthetic text of each size, for a pattern of each length in every search mode, and writes
+/// the fastest configuration of each bucket to the tuning profile. Search mode 3 is divided into
+/// chunks of a fixed size, so only its number of threads is timed.
+/// </summary>
+/// <param name="fileName">The tuning profile to write.</param>
+void calibrate(char* fileName)
+{
+    int nSizes = sizeof(calibrationSizes) / sizeof(calibrationSizes[0]);
+    int nPatterns = sizeof(calibrationPatterns) / sizeof(calibrationPatterns[0]);
+    int nBlocks = sizeof(calibrationBlocks) / sizeof(calibrationBlocks[0]);
+    char* text = (char*)malloc(calibrationSizes[nSizes - 1]);
+    char pattern[64];
+    TuningEntry* entry;
+    long time, fastest;
+
+    if (text == NULL)
+        outOfMemory();
+    tuning.count = 0;
+    seedSynthetic(0);
+
+    #pragma omp parallel default(shared) num_threads(numThreads)
+    {
+        int s, p, mode, threads, b, r;
+        for (s = 0; s < nSizes; s++)
+        {
+            int textLength = calibrationSizes[s];
+
+            #pragma omp single
+            fillRandomText(text, textLength, 4);
+
+            for (p = 0; p < nPatterns; p++)
+            {
+                int patternLength = calibrationPatterns[p];
+
+                #pragma omp single
+                {
+                    fillRandomText(pattern, patternLength, 4);
+                    plantMatches(text, textLength, pattern, patternLength, CALIBRATION_MATCHES);
+                }
+
+                for (mode = 0; mode < 4; mode++)
+                {
+                    #pragma omp single
+                    entry = setTuning(&tuning, lengthClass(textLength), lengthClass(patternLength), mode);
+
+                    // every thread, then half as many, down to one
+                    for (threads = numThreads; threads > 0; threads /= 2)
+                    {
+                        for (b = 0; b < (mode == 3 ? 1 : nBlocks); b++)
+                        {
+                            int blockSize = mode == 3 ? 0 : calibrationBlocks[b];
+                            for (r = 0; r < CALIBRATION_REPEATS; r++)
+                            {
+                                SearchResults results = { NULL, 0, 0, 0, discardLocation, NULL };
+
+                                #pragma omp single
+                                {
+                                    searchSetBlockSize(searchContext, blockSize);
+                                    searchSetThreads(searchContext, threads < numThreads ? threads : 0);
+                                    time = getNanos();
+                                }
+
+                                searchTeam(searchContext, mode, text, textLength, pattern, patternLength,
+                                    CALIBRATION_LIMIT, &results, NULL);
+
+                                // every thread has finished before the time is taken
+                                #pragma omp barrier
+                                #pragma omp single
+                                {
+                                    time = getNanos() - time;
+                                    if (r == 0 || time < fastest)
+                                        fastest = time;
+                                }
+                            }
+
+                            #pragma omp single
+                            {
+                                if (entry->seconds == 0 || fastest < entry->seconds * 1.0e9)
+                                {
+                                    entry->blockSize = blockSize;
+                                    entry->threads = threads;
+                                    entry->seconds = (double)fastest / 1.0e9;
+                                }
+                            }
+                        }
+                    }
+
+                    #pragma omp single
+                    printf("text %i pattern %i mode %i: block size %i, %i threads, %.09f\n", textLength,
+                        patternLength, mode, entry->blockSize, entry->threads, entry->seconds);
+                }
+            }
+        }
+    }
+
+    free(text);
+    searchSetBlockSize(searchContext, 0);
+    searchSetThreads(searchContext, 0);
+
+    if (saveTuning(&tuning, fileName))
+        printf("Tuning profile written to %s\n", fileName);
+}
 
 int main(int argc, char **argv)
 {
-    // program requires inputs directory to be specified.
-    if (argc < 1)
+    // program requires inputs directory to be specified, except to calibrate, which reads no inputs
+    directory = argc >= 2 && argv[1][0] != '-' ? argv[1] : NULL;
+
+    int serverMode = 0;
+    char* socketPath = NULL;
+    int threadsGiven = 0;
+    int profileGiven = 0;
+    int calibrateMode = 0;
+    int resumeMode = 0;
+    long resumeTests = 0;
+
+    int i;
+    for (i = directory != NULL ? 2 : 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            numThreads = atoi(argv[++i]);
+            threadsGiven = 1;
+        }
+        else if (strcmp(argv[i], "-counters") == 0)
+            countersMode = 1;
+        else if (strcmp(argv[i], "-numa") == 0)
+            numaMode = 1;
+        else if (strcmp(argv[i], "-server") == 0)
+        {
+            serverMode = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                socketPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-packed") == 0)
+            packedMode = 1;
+        else if (strcmp(argv[i], "-interleave") == 0 && i + 1 < argc)
+            interleaveSize = atol(argv[++i]);
+        else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+        {
+            profileFileName = argv[++i];
+            profileGiven = 1;
+        }
+        else if (strcmp(argv[i], "-prefetch") == 0)
+            prefetchMode = 1;
+        else if (strcmp(argv[i], "-lazy") == 0)
+            lazyMode = 1;
+        else if (strcmp(argv[i], "-calibrate") == 0)
+        {
+            calibrateMode = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                profileFileName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-checkpoint") == 0)
+        {
+            checkpointMode = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                windowLimit = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-resume") == 0 || strcmp(argv[i], "--resume") == 0)
+            resumeMode = checkpointMode = 1;
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            exit(0);
+        }
+    }
+
+    if (directory == NULL && !calibrateMode)
     {
         printf("Not enough arguments: No inputs directory provided.");
         exit(0);
     }
-    directory = argv[1];
 
-    // read texts and patterns into arrays.
-    textCount = readFiles(MAX_TEXTS, "text", textData, textLengths);
-    patternCount = readFiles(MAX_PATTERNS, "pattern", patternData, patternLengths);
+    // the team is as large as the most threads any bucket searches with
+    if (calibrateMode)
+    {
+        if (!threadsGiven)
+            numThreads = omp_get_num_procs();
+    }
+    else if (loadTuning(&tuning, profileFileName) >= 0)
+    {
+        int most = 0;
+        printf("Tuning profile %s: %i buckets\n", profileFileName, tuning.count);
+        for (i = 0; i < tuning.count; i++)
+        {
+            if (tuning.entries[i].threads > most)
+                most = tuning.entries[i].threads;
+        }
+        if (most > 0 && !threadsGiven)
+            numThreads = most;
+    }
+    else if (profileGiven)
+        printf("Could not open tuning profile %s\n", profileFileName);
+
+    if (numThreads > MAX_WORKERS)
+        numThreads = MAX_WORKERS;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    if (calibrateMode)
+    {
+        searchContext = searchCreate(numThreads);
+        if (searchContext == NULL)
+            outOfMemory();
+        calibrate(profileFileName);
+        searchDestroy(searchContext);
+        return 0;
+    }
+
+    if (windowLimit < 1 || windowLimit > CONTROL_WINDOW)
+        windowLimit = CONTROL_WINDOW;
+
+    // a resumed run drops any results written after its checkpoint and skips the tests before it
+    if (checkpointMode && !serverMode)
+    {
+        resumeTests = startCheckpoints(checkpointFileName, outputFileName, resumeMode);
+        if (resumeTests < 0)
+            exit(0);
+    }
+
+    loaderMode = prefetchMode || lazyMode;
+    if (loaderMode && (numaMode || packedMode || serverMode))
+    {
+        printf("-prefetch and -lazy are not used with -numa, -packed or -server\n");
+        loaderMode = 0;
+    }
+
+    if (loaderMode)
+    {
+        // every file is its own content, since the tests start before the files are compared
+        for (i = 0; i < MAX_TEXTS; i++)
+        {
+            textIds[i] = textOwners[i] = i;
+        }
+        for (i = 0; i < MAX_PATTERNS; i++)
+        {
+            patternIds[i] = i;
+        }
+
+        loader.printReads = 1;
+        loader.prefetch = prefetchMode;
+        loader.lazy = lazyMode;
+        loader.skip = resumeTests;
+        startLoader(&loader, directory, MAX_TEXTS, textData, textLengths, textLoadNanos,
+            MAX_PATTERNS, patternData, patternLengths, patternLoadNanos, readFromFile);
+    }
+    else
+    {
+        // read texts and patterns into arrays.
+        textCount = readFiles(MAX_TEXTS, "text", textData, textLengths, textLoadNanos);
+        patternCount = readFiles(MAX_PATTERNS, "pattern", patternData, patternLengths, patternLoadNanos);
+
+        // files with the same contents, or which are a prefix of another, share one buffer
+        long shared = shareContents("text", MAX_TEXTS, textData, textLengths, textIds, textOwners);
+        shared += shareContents("pattern", MAX_PATTERNS, patternData, patternLengths, patternIds, NULL);
+        if (shared > 0)
+            printf("%li bytes of texts and patterns shared\n", shared);
+    }
 
     //printf("Text Count = %i, Pattern Count = %i\n", textCount, patternCount);
 
-    // read control file data
-    int testCount = readControl();
+    if (packedMode)
+        packTexts();
 
-    // initialise buffer
-    char buffer[BUFFER_SIZE];
-    sprintf(buffer, "");
+    searchContext = searchCreate(numThreads);
+    if (searchContext == NULL)
+        outOfMemory();
+
+    // in NUMA mode each block is searched by the thread which placed it
+    searchSetPlaced(searchContext, numaMode);
+    if (numaMode)
+        readAllowedCpus();
+
+    if (serverMode)
+    {
+        serve(socketPath);
+        searchDestroy(searchContext);
+        return 0;
+    }
+
+    // control entries are read as the tests run
+    openControl(&control, directory, MAX_TEXTS, MAX_PATTERNS);
+    windowStart = (int)skipControlEntries(&control, resumeTests);
+
+    // run report is written next to the results, and continued by a resumed run
+    FILE* report = openReport(reportFileName, resumeTests > 0);
 
     // start time of program
     long elapsedTime = getNanos();
 
-    int idx = 0;
-    for (idx; idx < testCount; idx++)
+    // start time of current test
+    long time;
+
+    // a single team of threads runs every test, rather than starting a new team for each search.
+    // the team shares the work of each search with searchTeam
+    #pragma omp parallel default(shared) num_threads(numThreads)
     {
-        // start time of test
-        long time = getNanos();
+        if (numaMode)
+            placeTexts();
+
+        // each thread counts its own events
+        long long counterStart[COUNTER_EVENTS];
+        if (countersMode)
+            openCounters(&threadCounters[omp_get_thread_num()]);
+
+        while (1)
+        {
+            #pragma omp single
+            fillWindow();
+
+            int batchSize = windowCount;
+            if (batchSize == 0)
+                break;
+
+            int k;
+            for (k = 0; k < batchSize; k++)
+            {
+                int slot = runOrder[k];
+                int idx = windowStart + slot;
+                ControlEntry test = controlWindow[slot];
+
+                #pragma omp single
+                {
+                    // a test waits only for its own files
+                    if (loaderMode)
+                    {
+                        waitForFile(&loader, &loader.texts, test.textNumber);
+                        waitForFile(&loader, &loader.patterns, test.patternNumber);
+                    }
+
+                    resetMetrics(&metrics, idx, test.mode, test.textNumber, test.patternNumber);
+                    metrics.textLength = textLengths[test.textNumber];
+                    metrics.patternLength = patternLengths[test.patternNumber];
+                    metrics.loadNanos = textLoadNanos[test.textNumber] + patternLoadNanos[test.patternNumber];
+
+                    // a test answered by a multi-pattern search writes its own results
+                    copyFrom = answeredAhead[slot] ? -1 : findSameSearch(k);
 
-        runTest(controlData[idx][0],controlData[idx][1],controlData[idx][2], buffer);
+                    metrics.counted = countersMode;
+                    time = getNanos();
+                }
+
+                if (countersMode)
+                    readCounters(&threadCounters[omp_get_thread_num()], counterStart);
+
+                // the search of a group is attributed to its first test, later tests only write their results
+                int grouped = answeredAhead[slot] || copyFrom >= 0;
+                int found;
+                if (copyFrom >= 0)
+                {
+                    #pragma omp single
+                    copyOutput(&testOutputs[slot], &testOutputs[copyFrom], test.textNumber, test.patternNumber);
+                    found = testFound[copyFrom];
+                }
+                else
+                {
+                    answerGroup(slot);
+
+                    if (answeredAhead[slot])
+                        found = writeAnswered(slot);
+                    else
+                        found = runTest(test.mode, test.textNumber, test.patternNumber, test.limit, test.start, test.end,
+                            &testOutputs[slot]);
+                }
+
+                // the events of every thread are summed before the test is reported
+                if (countersMode)
+                {
+                    long long counterEnd[COUNTER_EVENTS];
+                    readCounters(&threadCounters[omp_get_thread_num()], counterEnd);
 
-        // elapsed time of test
-        time = getNanos() - time;
-        printf("\nTest %i elapsed time = %.09f\n\n", idx, (double)time / 1.0e9);
+                    #pragma omp critical
+                    addCounters(metrics.counters, counterStart, counterEnd);
+
+                    #pragma omp barrier
+                }
+
+                #pragma omp single
+                {
+                    metrics.matches = found;
+
+                    // elapsed time of test
+                    time = getNanos() - time;
+                    printf("\nTest %i elapsed time = %.09f\n\n", idx, (double)time / 1.0e9);
+
+                    metrics.searchNanos = time;
+                    if (grouped)
+                        memset(&searchStats, 0, sizeof(searchStats));
+                    recordSearchStats();
+                    writeReport(report, &metrics);
+                    testRun[slot] = 1;
+                    testFound[slot] = found;
+
+                    // files are freed after the last test naming them
+                    if (loaderMode && loader.lazy)
+                    {
+                        releaseFile(&loader, &loader.texts, test.textNumber);
+                        releaseFile(&loader, &loader.patterns, test.patternNumber);
+                    }
+                }
+            }
+
+            // results are written in control order
+            #pragma omp single
+            {
+                writeOutputs(outputFileName, testOutputs, batchSize);
+                windowStart += batchSize;
+                windowCount = 0;
+                if (checkpointMode)
+                    saveCheckpoint(checkpointFileName, windowStart, resultsLength(outputFileName));
+            }
+        }
+
+        if (countersMode)
+            closeCounters(&threadCounters[omp_get_thread_num()]);
+    }
+    closeControl(&control);
+    if (loaderMode)
+        stopLoader(&loader);
+
+    if (report != NULL)
+        fclose(report);
+
+    if (numaMode)
+    {
+        printf("\n");
+        writeSocketReport(stdout, numThreads, threadSocket, threadBytes, threadBusy, socketPlaced, interleavedPlaced);
     }
 
     // elapsed time of program
     elapsedTime = getNanos() - elapsedTime;
     printf("\nProgram elapsed time = %.09f\n\n", (double)elapsedTime / 1.0e9);
 
-    // write any remaining data file
-    writeBufferToOutput(buffer);
 
+    searchDestroy(searchContext);
 
-}
\ No newline at end of file
+
+}
@@ -0,0 +1,1388 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: search.c
+// Description: Implementation of the pattern searching library
+// declared in search.h.
+//
+// A search by a team divides the start positions of the text into
+// contiguous blocks of several megabytes, extended by patternLength - 1
+// characters so occurrences across blocks are found once, and every
+// thread runs a sequential search over the blocks it is given. Each
+// thread stores the locations it finds in its own scratch space, which
+// is kept in the context and reused by every later search, and one
+// thread delivers them in text order once every block is searched.
+// A search restricted to a range of the text (searchSetRange) divides
+// only the start positions of the range, and its locations stay offsets
+// in the whole text.
+//
+// Patterns of up to 16 characters are searched by kernels specialised
+// for their length, which compare a whole pattern of up to 8 characters
+// with one word load and comparison, and a single character with memchr.
+//
+// Many patterns of one length are searched together by a Rabin-Karp
+// search, which rolls a hash of the text once and looks each window up
+// in a hash set of the patterns, verifying every hash match exactly.
+// Hashes are polynomials modulo 2^64, so the hash of a window depends
+// only on its characters and each block starts from the hash of its
+// first window rather than the end of the previous block.
+//
+// A packed text stores each symbol in 2 or 4 bits, with the symbols
+// numbered in byte order. Its search compares up to 32 or 16 symbols
+// of the pattern with one masked 64-bit comparison, extracting the
+// text at any symbol offset from two neighbouring words.
+//
+/////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num() 0
+#define omp_get_num_threads() 1
+#endif
+
+#include "search.h"
+
+// default number of start positions in each block a thread searches
+#define BLOCK_SIZE 4194304
+
+// positions handed to a thread at a time when finding the first N occurrences
+#define FIRST_CHUNK_SIZE 65536
+
+// how often a search checks whether it is still needed, must be powers of 2.
+// serial searches poll less often since their poll callbacks may check for messages
+#define POLL_INTERVAL 1024
+#define SERIAL_POLL_INTERVAL 4096
+
+// scratch space of each thread, kept in the context so it is reused by every search
+typedef struct
+{
+    int* results; // locations found by the thread in the current search
+    int allocated;
+    int used;
+    long positions; // instrumentation counters
+    long comparisons;
+    long found;
+    long busy;
+} ThreadScratch;
+
+// base of the polynomial hashes of the Rabin-Karp search, odd so that it is invertible modulo 2^64
+#define HASH_BASE 0x100000001b3ULL
+
+// patterns searched together by searchTeamMulti, in a chained hash table keyed by their hashes
+typedef struct
+{
+    const char* const* patterns;
+    int count;
+    int length;
+    uint64_t* hashes; // hash of each pattern
+    int* table; // first pattern of each slot, or -1
+    int* next; // next pattern of the same slot, or -1
+    int tableBits;
+    uint64_t highPower; // HASH_BASE ^ (length - 1), the weight of the character leaving a window
+} PatternSet;
+
+struct SearchContext
+{
+    int threads; // threads started by searchText
+    int blockSize; // start positions in each block
+    int searchers; // threads of a team which search, 0 for every thread
+    int placed; // whether block b is searched by thread b % threads
+    int rangeStart; // first character of the text searched by team searches
+    int rangeEnd; // one past the last character searched, -1 for the end of the text
+
+    ThreadScratch scratch[SEARCH_MAX_THREADS];
+
+    // state shared by the team during a search, reset by one thread before each search
+    int found; // whether the pattern has been found by SEARCH_ANY
+    int stop; // blocks or chunks from this one onwards are not needed
+    int nextChunk; // next chunk to search in SEARCH_FIRST
+    int frontier; // every chunk before the frontier has been searched in SEARCH_FIRST
+    int frontierFound; // occurrences found before the frontier
+    int result; // result of the search, returned by every thread
+
+    // occurrences found by each block or chunk, and where the thread that searched it stored them.
+    // the arrays are only ever grown, so they are reused by every search
+    int* blockFound;
+    int* blockThread;
+    int* blockOffset;
+    char* blockDone;
+    int blockCapacity;
+
+    // patterns of the current searchTeamMulti
+    PatternSet patternSet;
+};
+
+struct SearchPacked
+{
+    int length; // symbols in the text
+    int bits; // bits per symbol, 2 or 4
+    unsigned char codes[256]; // code of each byte in the text
+    char present[256]; // whether each byte occurs in the text
+    uint64_t* words; // the symbols, followed by a zero word so any window can be read
+    int wordCount;
+};
+
+// a searching algorithm over a range of start positions, with the arguments of searchRange
+typedef int (*RangeKernel)(const char* text, int first, int last, const char* pattern, int patternLength, int limit,
+    int store, ThreadScratch* own, int pollMask, SearchPoll poll, void* pollState);
+
+// what a search looks for and where. Each thread builds its own copy
+typedef struct
+{
+    const char* text; // text stored a byte per symbol, or NULL when packed is used
+    const SearchPacked* packed;
+    const char* pattern;
+    int patternLength;
+    RangeKernel kernel; // searching algorithm for the pattern length over a text stored a byte per symbol
+
+    // the pattern encoded like the packed text, a word of symbols and a mask per chunk of the pattern
+    uint64_t* patternWords;
+    uint64_t* patternMasks;
+    int patternChunks;
+} SearchJob;
+
+// the start positions a team search covers, those of occurrences within the range of the context
+typedef struct
+{
+    int first; // first start position searched
+    int positions; // start positions searched from first
+    int textLength; // characters of the whole text, which placed blocks are counted from
+    int textPositions; // start positions of the whole text, which placed blocks divide
+} SearchSpan;
+
+// identifies a block to the poll that checks whether it is still needed
+typedef struct
+{
+    SearchContext* context;
+    int block;
+} BlockPoll;
+
+static void outOfMemory()
+{
+    fprintf(stderr, "Out of memory\n");
+    exit(0);
+}
+
+/// <summary>
+/// Gets the current time in nanoseconds.
+/// </summary>
+/// <returns>The time in nanoseconds.</returns>
+static long getNanos()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+SearchContext* searchCreate(int threads)
+{
+    SearchContext* context = (SearchContext*)calloc(1, sizeof(SearchContext));
+    if (context == NULL)
+        return NULL;
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > SEARCH_MAX_THREADS)
+        threads = SEARCH_MAX_THREADS;
+    context->threads = threads;
+    context->blockSize = BLOCK_SIZE;
+    context->rangeEnd = -1;
+    return context;
+}
+
+void searchDestroy(SearchContext* context)
+{
+    int t;
+    if (context == NULL)
+        return;
+
+    for (t = 0; t < SEARCH_MAX_THREADS; t++)
+    {
+        free(context->scratch[t].results);
+    }
+    free(context->blockFound);
+    free(context->blockThread);
+    free(context->blockOffset);
+    free(context->blockDone);
+    free(context);
+}
+
+void searchSetBlockSize(SearchContext* context, int blockSize)
+{
+    context->blockSize = blockSize > 0 ? blockSize : BLOCK_SIZE;
+}
+
+void searchSetThreads(SearchContext* context, int threads)
+{
+    context->searchers = threads > 0 ? threads : 0;
+}
+
+void searchSetRange(SearchContext* context, int start, int end)
+{
+    context->rangeStart = start > 0 ? start : 0;
+    context->rangeEnd = end >= 0 ? end : -1;
+}
+
+void searchSetPlaced(SearchContext* context, int placed)
+{
+    context->placed = placed;
+}
+
+int searchBlockCount(SearchContext* context, int positions, int threads)
+{
+    // at least one block per thread, so that short texts are still divided among every thread
+    int nBlocks = (int)(((long)positions + context->blockSize - 1) / context->blockSize);
+    if (context->searchers > 0 && threads > context->searchers)
+        threads = context->searchers;
+    if (nBlocks < threads)
+        nBlocks = threads;
+
+    // with fewer searchers than threads, blocks are given to at most that many threads
+    if (context->searchers > 0 && nBlocks > context->searchers)
+        nBlocks = context->searchers;
+    if (nBlocks > positions)
+        nBlocks = positions;
+    return nBlocks;
+}
+
+int searchBlockStart(int block, int nBlocks, int positions)
+{
+    // positions are divided evenly among the blocks, the way searchDivideWorkload divides a text among processes
+    return (int)((long)block * positions / nBlocks);
+}
+
+/// <summary>
+/// Delivers the location of an occurrence to the caller.
+/// </summary>
+/// <param name="results">Where to deliver the location, or NULL.</param>
+/// <param name="location">The location of the occurrence.</param>
+static void deliver(SearchResults* results, int location)
+{
+    if (results == NULL)
+        return;
+
+    if (results->stored == results->capacity && results->grow)
+    {
+        results->capacity = results->capacity ? results->capacity * 2 : 16;
+        results->locations = (int*)realloc(results->locations, results->capacity * sizeof(int));
+        if (results->locations == NULL)
+            outOfMemory();
+    }
+    if (results->stored < results->capacity)
+        results->locations[results->stored++] = location;
+
+    if (results->callback != NULL)
+        results->callback(results->state, location);
+}
+
+/// <summary>
+/// Appends the location of an occurrence to the results of the calling thread. The thread's
+/// results grow geometrically and are kept for later searches.
+/// </summary>
+/// <param name="own">The scratch space of the calling thread.</param>
+/// <param name="location">The location of the occurrence.</param>
+static inline void storeLocation(ThreadScratch* own, int location)
+{
+    if (own->used == own->allocated)
+    {
+        own->allocated = own->allocated ? own->allocated * 2 : 1024;
+        own->results = (int*)realloc(own->results, own->allocated * sizeof(int));
+        if (own->results == NULL)
+            outOfMemory();
+    }
+    own->results[own->used++] = location;
+}
+
+/// <summary>
+/// Sequential searching algorithm which searches a contiguous range of start positions. The
+/// range reads up to patternLength - 1 characters past its last start position, so that
+/// occurrences across ranges are found by exactly one range.
+/// </summary>
+/// <param name="text">The Text to search.</param>
+/// <param name="first">The first start position to search from.</param>
+/// <param name="last">The last start position to search from.</param>
+/// <param name="pattern">The Pattern to search for.</param>
+/// <param name="patternLength">The Length of the Pattern.</param>
+/// <param name="limit">The number of occurrences after which the search completes.</param>
+/// <param name="store">Whether to append the locations found to the thread's results.</param>
+/// <param name="own">The scratch space of the calling thread.</param>
+/// <param name="pollMask">One less than the number of positions between polls.</param>
+/// <param name="poll">Called to check whether the range is still needed, or NULL to never abandon it.</param>
+/// <param name="pollState">Passed to poll.</param>
+/// <returns>The number of occurrences found, or -1 if the search was abandoned.</returns>
+static int searchRange(const char* text, int first, int last, const char* pattern, int patternLength, int limit,
+    int store, ThreadScratch* own, int pollMask, SearchPoll poll, void* pollState)
+{
+    int i, j;
+    int found = 0;
+    long compared = 0;
+
+    for (i = first; i <= last && found < limit; i++)
+    {
+        // check if the range is still needed
+        if (poll != NULL && ((i - first) & pollMask) == 0 && poll(pollState))
+        {
+            // discard anything stored by the abandoned range
+            if (store)
+                own->used -= found;
+            found = -1;
+            break;
+        }
+
+        j = 0;
+        while (j < patternLength && text[i + j] == pattern[j])
+        {
+            j++;
+        }
+        // every matched character plus the mismatch, if the loop ended on one
+        compared += j + (j < patternLength);
+
+        if (j == patternLength)
+        {
+            if (store)
+                storeLocation(own, i);
+            found++;
+        }
+    }
+
+    own->positions += i - first;
+    own->comparisons += compared;
+    return found;
+}
+
+/// <summary>
+/// Searching algorithm for patterns of one character, which finds each candidate with memchr.
+/// Takes the same arguments as searchRange. Each character memchr passes over counts as a comparison.
+/// </summary>
+static int searchRange1(const char* text, int first, int last, const char* pattern, int patternLength, int limit,
+    int store, ThreadScratch* own, int pollMask, SearchPoll poll, void* pollState)
+{
+    int i = first;
+    int found = 0;
+
+    while (i <= last && found < limit)
+    {
+        // check if the range is still needed once every pollMask + 1 positions
+        if (poll != NULL && poll(pollState))
+        {
+            if (store)
+                own->used -= found;
+            found = -1;
+            break;
+        }
+        int end = poll != NULL && last - i > pollMask ? i + pollMask : last;
+
+        while (i <= end && found < limit)
+        {
+            const char* hit = (const char*)memchr(text + i, pattern[0], end - i + 1);
+            if (hit == NULL)
+            {
+                i = end + 1;
+                break;
+            }
+            i = (int)(hit - text);
+            if (store)
+                storeLocation(own, i);
+            found++;
+            i++;
+        }
+    }
+
+    own->positions += i - first;
+    own->comparisons += i - first;
+    return found;
+}
+
+/// <summary>
+/// Loads up to the first 8 characters of a string into a word. With a constant length the
+/// load compiles to one or two unaligned loads.
+/// </summary>
+static inline uint64_t loadHead(const char* data, int length)
+{
+    uint64_t word = 0;
+    memcpy(&word, data, length < 8 ? length : 8);
+    return word;
+}
+
+/// <summary>
+/// Loads the characters after the first 8 of a string of at most 16 characters into a word.
+/// </summary>
+static inline uint64_t loadTail(const char* data, int length)
+{
+    uint64_t word = 0;
+    if (length > 8)
+        memcpy(&word, data + 8, length - 8);
+    return word;
+}
+
+// defines searchRangeN, the searching algorithm for patterns of N characters where N is 2 to 16.
+// each position is compared with one word comparison when N is at most 8, or two otherwise,
+// and counts one comparison for each
+#define SHORT_KERNEL(N) \
+static int searchRange##N(const char* text, int first, int last, const char* pattern, int patternLength, int limit, \
+    int store, ThreadScratch* own, int pollMask, SearchPoll poll, void* pollState) \
+{ \
+    uint64_t head = loadHead(pattern, N); \
+    uint64_t tail = loadTail(pattern, N); \
+    int i; \
+    int found = 0; \
+    long compared = 0; \
+    \
+    for (i = first; i <= last && found < limit; i++) \
+    { \
+        if (poll != NULL && ((i - first) & pollMask) == 0 && poll(pollState)) \
+        { \
+            if (store) \
+                own->used -= found; \
+            found = -1; \
+            break; \
+        } \
+        \
+        compared++; \
+        if (loadHead(text + i, N) == head && (N <= 8 || (compared++, loadTail(text + i, N) == tail))) \
+        { \
+            if (store) \
+                storeLocation(own, i); \
+            found++; \
+        } \
+    } \
+    \
+    own->positions += i - first; \
+    own->comparisons += compared; \
+    return found; \
+}
+
+SHORT_KERNEL(2)
+SHORT_KERNEL(3)
+SHORT_KERNEL(4)
+SHORT_KERNEL(5)
+SHORT_KERNEL(6)
+SHORT_KERNEL(7)
+SHORT_KERNEL(8)
+SHORT_KERNEL(9)
+SHORT_KERNEL(10)
+SHORT_KERNEL(11)
+SHORT_KERNEL(12)
+SHORT_KERNEL(13)
+SHORT_KERNEL(14)
+SHORT_KERNEL(15)
+SHORT_KERNEL(16)
+
+// kernels specialised for each pattern length up to SHORT_PATTERN_LENGTH
+#define SHORT_PATTERN_LENGTH 16
+static const RangeKernel shortKernels[SHORT_PATTERN_LENGTH + 1] =
+{
+    NULL, searchRange1, searchRange2, searchRange3, searchRange4, searchRange5, searchRange6, searchRange7,
+    searchRange8, searchRange9, searchRange10, searchRange11, searchRange12, searchRange13, searchRange14,
+    searchRange15, searchRange16
+};
+
+/// <summary>
+/// Gets the searching algorithm for a pattern length, specialised for short patterns.
+/// </summary>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <returns>The searching algorithm.</returns>
+static RangeKernel selectKernel(int patternLength)
+{
+    if (patternLength >= 1 && patternLength <= SHORT_PATTERN_LENGTH)
+        return shortKernels[patternLength];
+    return searchRange;
+}
+
+/// <summary>
+/// Gets the 64 bits of a packed text starting at a symbol.
+/// </summary>
+/// <param name="packed">The packed text.</param>
+/// <param name="symbol">The position of the first symbol.</param>
+/// <returns>The word of symbols starting at symbol.</returns>
+static inline uint64_t packedWindow(const SearchPacked* packed, int symbol)
+{
+    long bit = (long)symbol * packed->bits;
+    long word = bit >> 6;
+    int shift = (int)(bit & 63);
+
+    if (shift == 0)
+        return packed->words[word];
+    return (packed->words[word] >> shift) | (packed->words[word + 1] << (64 - shift));
+}
+
+/// <summary>
+/// Sequential searching algorithm over a packed text, which compares a whole word of symbols
+/// of the pattern at a time. Takes the same arguments as searchRange.
+/// </summary>
+static int searchPackedRange(const SearchJob* job, int first, int last, int limit,
+    int store, ThreadScratch* own, int pollMask, SearchPoll poll, void* pollState)
+{
+    const SearchPacked* packed = job->packed;
+    int symbolsPerWord = 64 / packed->bits;
+    int i, c;
+    int found = 0;
+    long compared = 0;
+
+    for (i = first; i <= last && found < limit; i++)
+    {
+        // check if the range is still needed
+        if (poll != NULL && ((i - first) & pollMask) == 0 && poll(pollState))
+        {
+            if (store)
+                own->used -= found;
+            found = -1;
+            break;
+        }
+
+        c = 0;
+        while (c < job->patternChunks &&
+            (packedWindow(packed, i + c * symbolsPerWord) & job->patternMasks[c]) == job->patternWords[c])
+        {
+            c++;
+        }
+        // every word compared, each of which compares many symbols
+        compared += c + (c < job->patternChunks);
+
+        if (c == job->patternChunks)
+        {
+            if (store)
+                storeLocation(own, i);
+            found++;
+        }
+    }
+
+    own->positions += i - first;
+    own->comparisons += compared;
+    return found;
+}
+
+/// <summary>
+/// Searches a range of start positions of a job with the kernel for its text.
+/// </summary>
+static int scanRange(const SearchJob* job, int first, int last, int limit,
+    int store, ThreadScratch* own, int pollMask, SearchPoll poll, void* pollState)
+{
+    if (job->packed != NULL)
+        return searchPackedRange(job, first, last, limit, store, own, pollMask, poll, pollState);
+    return job->kernel(job->text, first, last, job->pattern, job->patternLength, limit, store, own, pollMask, poll, pollState);
+}
+
+/// <summary>
+/// Encodes the pattern of a job like its packed text, a word of symbols and a mask for every
+/// chunk of the pattern that fits in a word.
+/// </summary>
+/// <param name="job">The job, whose packed text is set.</param>
+/// <returns>1 if the pattern may occur, 0 if it holds a byte the text does not.</returns>
+static int encodePattern(SearchJob* job)
+{
+    const SearchPacked* packed = job->packed;
+    int symbolsPerWord = 64 / packed->bits;
+    int p;
+
+    for (p = 0; p < job->patternLength; p++)
+    {
+        if (!packed->present[(unsigned char)job->pattern[p]])
+            return 0;
+    }
+
+    job->patternChunks = (job->patternLength + symbolsPerWord - 1) / symbolsPerWord;
+    job->patternWords = (uint64_t*)calloc(2 * job->patternChunks, sizeof(uint64_t));
+    if (job->patternWords == NULL)
+        outOfMemory();
+    job->patternMasks = job->patternWords + job->patternChunks;
+
+    uint64_t symbolMask = ((uint64_t)1 << packed->bits) - 1;
+    for (p = 0; p < job->patternLength; p++)
+    {
+        int chunk = p / symbolsPerWord;
+        int shift = (p % symbolsPerWord) * packed->bits;
+        job->patternWords[chunk] |= (uint64_t)packed->codes[(unsigned char)job->pattern[p]] << shift;
+        job->patternMasks[chunk] |= symbolMask << shift;
+    }
+    return 1;
+}
+
+/// <summary>
+/// Polls whether a block or chunk of a team search is still needed.
+/// </summary>
+/// <param name="state">The BlockPoll of the block.</param>
+/// <returns>1 if the block is no longer needed, otherwise 0.</returns>
+static int blockStopped(void* state)
+{
+    BlockPoll* block = (BlockPoll*)state;
+    int stop;
+
+    #pragma omp atomic read
+    stop = block->context->stop;
+
+    return block->block >= stop;
+}
+
+/// <summary>
+/// Makes sure the shared block arrays can describe nBlocks blocks.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="nBlocks">The number of blocks in the next search.</param>
+static void reserveBlocks(SearchContext* context, int nBlocks)
+{
+    if (nBlocks <= context->blockCapacity)
+        return;
+
+    context->blockFound = (int*)realloc(context->blockFound, nBlocks * sizeof(int));
+    context->blockThread = (int*)realloc(context->blockThread, nBlocks * sizeof(int));
+    context->blockOffset = (int*)realloc(context->blockOffset, nBlocks * sizeof(int));
+    context->blockDone = (char*)realloc(context->blockDone, nBlocks * sizeof(char));
+    if (context->blockFound == NULL || context->blockThread == NULL || context->blockOffset == NULL || context->blockDone == NULL)
+        outOfMemory();
+    context->blockCapacity = nBlocks;
+}
+
+/// <summary>
+/// Prepares a team search. Every thread clears its own scratch space, while one thread resets
+/// the state shared by the team.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="nBlocks">The number of blocks or chunks in the search.</param>
+/// <param name="stats">Instrumentation of the search, or NULL.</param>
+static void beginSearch(SearchContext* context, int nBlocks, SearchStats* stats)
+{
+    ThreadScratch* own = &context->scratch[omp_get_thread_num()];
+    own->used = 0;
+    own->positions = 0;
+    own->comparisons = 0;
+    own->found = 0;
+
+    #pragma omp single
+    {
+        reserveBlocks(context, nBlocks);
+        memset(context->blockDone, 0, nBlocks * sizeof(char));
+        context->found = 0;
+        context->stop = nBlocks;
+        context->nextChunk = 0;
+        context->frontier = 0;
+        context->frontierFound = 0;
+        if (stats != NULL)
+            memset(stats, 0, sizeof(SearchStats));
+    }
+
+    own->busy = getNanos();
+}
+
+/// <summary>
+/// Completes a team search. Each thread records how long it was busy before waiting for the
+/// rest of the team.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="stats">Instrumentation of the search, or NULL.</param>
+static void endSearch(SearchContext* context, SearchStats* stats)
+{
+    int thread = omp_get_thread_num();
+    ThreadScratch* own = &context->scratch[thread];
+
+    if (stats != NULL)
+    {
+        stats->busyNanos[thread] = getNanos() - own->busy;
+        stats->workerPositions[thread] = own->positions;
+    }
+
+    #pragma omp barrier
+}
+
+/// <summary>
+/// Sums the instrumentation counters of every thread. Called by one thread once the search is complete.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="stats">Instrumentation of the search, or NULL.</param>
+/// <returns>The number of occurrences counted by every thread.</returns>
+static long sumThreads(SearchContext* context, SearchStats* stats)
+{
+    int t;
+    long found = 0;
+    int threads = omp_get_num_threads();
+
+    for (t = 0; t < threads; t++)
+    {
+        found += context->scratch[t].found;
+        if (stats != NULL)
+        {
+            stats->positions += context->scratch[t].positions;
+            stats->comparisons += context->scratch[t].comparisons;
+        }
+    }
+    if (stats != NULL)
+        stats->workers = threads;
+    return found;
+}
+
+/// <summary>
+/// Gets the start positions a team search covers, those of occurrences within the range of the context.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="span">The span to fill in.</param>
+/// <returns>1 if the span holds any start position, otherwise 0.</returns>
+static int searchSpan(SearchContext* context, int textLength, int patternLength, SearchSpan* span)
+{
+    int end = context->rangeEnd < 0 || context->rangeEnd > textLength ? textLength : context->rangeEnd;
+    span->first = context->rangeStart;
+    span->positions = end - patternLength + 1 - span->first;
+    span->textLength = textLength;
+    span->textPositions = textLength - patternLength + 1;
+    return span->positions > 0;
+}
+
+/// <summary>
+/// Gets the number of blocks of a team search. Placed blocks are counted from the characters of
+/// the whole text, as placeTexts counts them, so block b is the block thread b % threads placed.
+/// </summary>
+static int spanBlockCount(SearchContext* context, const SearchSpan* span)
+{
+    return searchBlockCount(context, context->placed ? span->textLength : span->positions, omp_get_num_threads());
+}
+
+/// <summary>
+/// Gets the start positions of a block of a team search. Blocks divide the span, except placed
+/// blocks, which divide the start positions of the whole text and are cut to the span. A placed
+/// block may hold no start position when the text has fewer of them than blocks.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="span">The start positions of the search.</param>
+/// <param name="nBlocks">The number of blocks.</param>
+/// <param name="b">The block.</param>
+/// <param name="first">Set to the first start position of the block.</param>
+/// <param name="last">Set to the last start position of the block.</param>
+/// <returns>1 if the block holds any start position of the span, otherwise 0.</returns>
+static int spanBlock(SearchContext* context, const SearchSpan* span, int nBlocks, int b, int* first, int* last)
+{
+    int positions = context->placed ? span->textPositions : span->positions;
+    int base = context->placed ? 0 : span->first;
+
+    *first = base + searchBlockStart(b, nBlocks, positions);
+    *last = base + searchBlockStart(b + 1, nBlocks, positions) - 1;
+    if (*first < span->first)
+        *first = span->first;
+    if (*last > span->first + span->positions - 1)
+        *last = span->first + span->positions - 1;
+    return *first <= *last;
+}
+
+/// <summary>
+/// Searches one block of a SEARCH_ANY, SEARCH_ALL or SEARCH_COUNT search.
+/// </summary>
+static void searchBlock(SearchContext* context, int mode, const SearchJob* job, const SearchSpan* span, int nBlocks, int b)
+{
+    int thread = omp_get_thread_num();
+    ThreadScratch* own = &context->scratch[thread];
+    int first, last;
+
+    // a placed block outside the range finds nothing
+    if (!spanBlock(context, span, nBlocks, b, &first, &last))
+    {
+        context->blockThread[b] = thread;
+        context->blockOffset[b] = own->used;
+        context->blockFound[b] = 0;
+        return;
+    }
+
+    if (mode == SEARCH_ANY)
+    {
+        BlockPoll block = { context, b };
+        int found = scanRange(job, first, last, 1, 0, own, POLL_INTERVAL - 1, blockStopped, &block);
+
+        if (found > 0)
+        {
+            // once the pattern is found, every block stops searching
+            #pragma omp critical(set)
+            {
+                context->found = 1;
+                #pragma omp atomic write
+                context->stop = 0;
+            }
+        }
+    }
+    else if (mode == SEARCH_COUNT)
+    {
+        own->found += scanRange(job, first, last, INT_MAX, 0, own, 0, NULL, NULL);
+    }
+    else
+    {
+        // each thread appends the results of its blocks to its own scratch space, and the blocks
+        // are delivered in text order once every block is searched
+        context->blockThread[b] = thread;
+        context->blockOffset[b] = own->used;
+        context->blockFound[b] = scanRange(job, first, last, INT_MAX, 1, own, 0, NULL, NULL);
+    }
+}
+
+/// <summary>
+/// Team search of the SEARCH_ANY, SEARCH_ALL and SEARCH_COUNT modes, which search every block
+/// of the text unless SEARCH_ANY finds the pattern.
+/// </summary>
+static int searchBlocks(SearchContext* context, int mode, const SearchJob* job, const SearchSpan* span,
+    SearchResults* results, SearchStats* stats)
+{
+    int nBlocks = spanBlockCount(context, span);
+    int b;
+
+    beginSearch(context, nBlocks, stats);
+
+    // no wait, so that busy time excludes time spent waiting on other threads.
+    // Blocks are scheduled dynamically to balance texts where occurrences are clustered,
+    // unless each block must stay with the thread that placed it
+    if (context->placed)
+    {
+        #pragma omp for schedule(static,1) nowait
+        for (b = 0; b < nBlocks; b++)
+        {
+            searchBlock(context, mode, job, span, nBlocks, b);
+        }
+    }
+    else
+    {
+        #pragma omp for schedule(dynamic,1) nowait
+        for (b = 0; b < nBlocks; b++)
+        {
+            searchBlock(context, mode, job, span, nBlocks, b);
+        }
+    }
+
+    endSearch(context, stats);
+
+    #pragma omp single
+    {
+        long found = sumThreads(context, stats);
+
+        if (mode == SEARCH_ANY)
+        {
+            found = context->found;
+        }
+        else if (mode != SEARCH_COUNT)
+        {
+            int r;
+            found = 0;
+            for (b = 0; b < nBlocks; b++)
+            {
+                int* blockResults = context->scratch[context->blockThread[b]].results + context->blockOffset[b];
+                for (r = 0; r < context->blockFound[b]; r++)
+                {
+                    deliver(results, blockResults[r]);
+                }
+                found += context->blockFound[b];
+            }
+        }
+        context->result = (int)found;
+    }
+
+    return context->result;
+}
+
+/// <summary>
+/// Team search of the SEARCH_FIRST mode. The text is split into chunks which are handed to
+/// threads in order. Once every chunk up to some point has been searched and holds at least
+/// limit occurrences between them, the chunks after it cannot change the result, so they are
+/// not started and chunks in progress are abandoned. Chunks are much smaller than the blocks
+/// used by the other searches, so that little of the text is searched past the last occurrence.
+/// </summary>
+static int searchFirst(SearchContext* context, const SearchJob* job, const SearchSpan* span, int limit,
+    SearchResults* results, SearchStats* stats)
+{
+    // last index in text to search from
+    int lastI = span->first + span->positions - 1;
+    int nChunks = (span->positions + FIRST_CHUNK_SIZE - 1) / FIRST_CHUNK_SIZE;
+    int chunk, stop;
+
+    int thread = omp_get_thread_num();
+    ThreadScratch* own = &context->scratch[thread];
+    beginSearch(context, nChunks, stats);
+
+    // threads beyond the searchers take no chunks
+    while (context->searchers == 0 || thread < context->searchers)
+    {
+        // chunks are taken in text order so the earliest occurrences are found first
+        #pragma omp atomic capture
+        chunk = context->nextChunk++;
+
+        #pragma omp atomic read
+        stop = context->stop;
+
+        if (chunk >= stop)
+            break;
+
+        int first = span->first + chunk * FIRST_CHUNK_SIZE;
+        int last = first + FIRST_CHUNK_SIZE - 1;
+        if (last > lastI)
+            last = lastI;
+
+        // at most limit occurrences per chunk, since later ones can never be reported
+        BlockPoll block = { context, chunk };
+        int offset = own->used;
+        int found = scanRange(job, first, last, limit, 1, own, POLL_INTERVAL - 1, blockStopped, &block);
+
+        // an earlier chunk made this one unnecessary
+        if (found < 0)
+            continue;
+
+        // record the chunk and advance the frontier over every finished chunk
+        #pragma omp critical(first)
+        {
+            context->blockFound[chunk] = found;
+            context->blockThread[chunk] = thread;
+            context->blockOffset[chunk] = offset;
+            context->blockDone[chunk] = 1;
+
+            while (context->frontier < nChunks && context->blockDone[context->frontier])
+            {
+                context->frontierFound += context->blockFound[context->frontier];
+                context->frontier++;
+            }
+
+            if (context->frontierFound >= limit && context->frontier < context->stop)
+            {
+                #pragma omp atomic write
+                context->stop = context->frontier;
+            }
+        }
+    }
+
+    endSearch(context, stats);
+
+    #pragma omp single
+    {
+        sumThreads(context, stats);
+
+        // deliver the first limit occurrences in text order, every chunk before the frontier is done
+        int delivered = 0;
+        int c, r;
+        for (c = 0; c < context->frontier && delivered < limit; c++)
+        {
+            int* chunkResults = context->scratch[context->blockThread[c]].results + context->blockOffset[c];
+            for (r = 0; r < context->blockFound[c] && delivered < limit; r++, delivered++)
+            {
+                deliver(results, chunkResults[r]);
+            }
+        }
+        context->result = delivered;
+    }
+
+    return context->result;
+}
+
+/// <summary>
+/// Completes a team search which cannot find the pattern without searching.
+/// </summary>
+static int searchNothing(SearchStats* stats)
+{
+    #pragma omp single
+    {
+        if (stats != NULL)
+            memset(stats, 0, sizeof(SearchStats));
+    }
+    return 0;
+}
+
+/// <summary>
+/// Searches a job with the calling team, once the pattern is known to fit in the text.
+/// </summary>
+static int searchJob(SearchContext* context, int mode, const SearchJob* job, int textLength, int limit,
+    SearchResults* results, SearchStats* stats)
+{
+    // a range shorter than the pattern holds no occurrence
+    SearchSpan span;
+    if (!searchSpan(context, textLength, job->patternLength, &span))
+        return searchNothing(stats);
+
+    if (mode == SEARCH_FIRST)
+        return searchFirst(context, job, &span, limit < 1 ? 1 : limit, results, stats);
+    if (mode != SEARCH_ANY && mode != SEARCH_COUNT)
+        mode = SEARCH_ALL;
+    return searchBlocks(context, mode, job, &span, results, stats);
+}
+
+int searchTeam(SearchContext* context, int mode, const char* text, int textLength, const char* pattern,
+    int patternLength, int limit, SearchResults* results, SearchStats* stats)
+{
+    // a pattern longer than the text never occurs
+    if (textLength < patternLength || patternLength < 1)
+        return searchNothing(stats);
+
+    SearchJob job = { text, NULL, pattern, patternLength, selectKernel(patternLength), NULL, NULL, 0 };
+    return searchJob(context, mode, &job, textLength, limit, results, stats);
+}
+
+int searchTeamPacked(SearchContext* context, int mode, const SearchPacked* text, const char* pattern,
+    int patternLength, int limit, SearchResults* results, SearchStats* stats)
+{
+    if (text->length < patternLength || patternLength < 1)
+        return searchNothing(stats);
+
+    SearchJob job = { NULL, text, pattern, patternLength, NULL, NULL, NULL, 0 };
+    if (!encodePattern(&job))
+        return searchNothing(stats);
+
+    int result = searchJob(context, mode, &job, text->length, limit, results, stats);
+    free(job.patternWords);
+    return result;
+}
+
+SearchPacked* searchPack(const char* text, int textLength)
+{
+    char present[256];
+    int symbols = 0;
+    int i;
+
+    memset(present, 0, sizeof(present));
+    for (i = 0; i < textLength; i++)
+    {
+        present[(unsigned char)text[i]] = 1;
+    }
+    for (i = 0; i < 256; i++)
+    {
+        symbols += present[i];
+    }
+    if (symbols > 16 || textLength < 1)
+        return NULL;
+
+    SearchPacked* packed = (SearchPacked*)calloc(1, sizeof(SearchPacked));
+    if (packed == NULL)
+        return NULL;
+    packed->length = textLength;
+    packed->bits = symbols <= 4 ? 2 : 4;
+    memcpy(packed->present, present, sizeof(present));
+
+    // symbols are numbered in byte order
+    int code = 0;
+    for (i = 0; i < 256; i++)
+    {
+        if (present[i])
+            packed->codes[i] = code++;
+    }
+
+    int symbolsPerWord = 64 / packed->bits;
+    packed->wordCount = (textLength + symbolsPerWord - 1) / symbolsPerWord + 1;
+    packed->words = (uint64_t*)calloc(packed->wordCount, sizeof(uint64_t));
+    if (packed->words == NULL)
+    {
+        free(packed);
+        return NULL;
+    }
+
+    for (i = 0; i < textLength; i++)
+    {
+        packed->words[i / symbolsPerWord] |= (uint64_t)packed->codes[(unsigned char)text[i]] << ((i % symbolsPerWord) * packed->bits);
+    }
+    return packed;
+}
+
+void searchFreePacked(SearchPacked* packed)
+{
+    if (packed == NULL)
+        return;
+    free(packed->words);
+    free(packed);
+}
+
+int searchPackedLength(const SearchPacked* packed)
+{
+    return packed->length;
+}
+
+long searchPackedBytes(const SearchPacked* packed)
+{
+    return (long)packed->wordCount * sizeof(uint64_t);
+}
+
+/// <summary>
+/// Gets the polynomial hash of a string.
+/// </summary>
+static uint64_t hashString(const char* data, int length)
+{
+    uint64_t hash = 0;
+    int i;
+    for (i = 0; i < length; i++)
+    {
+        hash = hash * HASH_BASE + (unsigned char)data[i];
+    }
+    return hash;
+}
+
+/// <summary>
+/// Gets the slot of the pattern set's table a hash belongs to.
+/// </summary>
+static inline int hashSlot(const PatternSet* set, uint64_t hash)
+{
+    // the high bits of the product mix every bit of the hash
+    return (int)((hash * 0x9E3779B97F4A7C15ULL) >> (64 - set->tableBits));
+}
+
+/// <summary>
+/// Builds the hash table of the patterns of a multi-pattern search. Called by one thread.
+/// </summary>
+static void buildPatternSet(PatternSet* set, const char* const patterns[], int patternCount, int patternLength)
+{
+    int p;
+    set->patterns = patterns;
+    set->count = patternCount;
+    set->length = patternLength;
+
+    // at least twice as many slots as patterns, so chains stay short
+    set->tableBits = 1;
+    while ((1 << set->tableBits) < 2 * patternCount)
+    {
+        set->tableBits++;
+    }
+
+    set->hashes = (uint64_t*)malloc(patternCount * sizeof(uint64_t));
+    set->table = (int*)malloc((1 << set->tableBits) * sizeof(int));
+    set->next = (int*)malloc(patternCount * sizeof(int));
+    if (set->hashes == NULL || set->table == NULL || set->next == NULL)
+        outOfMemory();
+    memset(set->table, -1, (1 << set->tableBits) * sizeof(int));
+
+    set->highPower = 1;
+    for (p = 1; p < patternLength; p++)
+    {
+        set->highPower *= HASH_BASE;
+    }
+
+    // patterns are pushed in reverse so each chain lists its patterns in order
+    for (p = patternCount - 1; p >= 0; p--)
+    {
+        set->hashes[p] = hashString(patterns[p], patternLength);
+        int slot = hashSlot(set, set->hashes[p]);
+        set->next[p] = set->table[slot];
+        set->table[slot] = p;
+    }
+}
+
+/// <summary>
+/// Searches one block of a multi-pattern search, rolling the hash of each window from the one
+/// before. The occurrences are stored in the thread's scratch space as pairs of the pattern
+/// number and location.
+/// </summary>
+static void searchMultiBlock(SearchContext* context, const char* text, const SearchSpan* span, int nBlocks, int b)
+{
+    int thread = omp_get_thread_num();
+    ThreadScratch* own = &context->scratch[thread];
+    const PatternSet* set = &context->patternSet;
+    int length = set->length;
+    int first, last;
+    int i, p;
+    int found = 0;
+
+    context->blockThread[b] = thread;
+    context->blockOffset[b] = own->used;
+    context->blockFound[b] = 0;
+    if (!spanBlock(context, span, nBlocks, b, &first, &last))
+        return;
+
+    // the hash of the first window is computed directly, which gives the same hash rolling
+    // from the start of the text would
+    uint64_t hash = hashString(text + first, length);
+    long compared = length;
+
+    for (i = first; i <= last; i++)
+    {
+        compared++;
+        for (p = set->table[hashSlot(set, hash)]; p >= 0; p = set->next[p])
+        {
+            if (set->hashes[p] != hash)
+                continue;
+
+            compared += length;
+            if (memcmp(text + i, set->patterns[p], length) == 0)
+            {
+                storeLocation(own, p);
+                storeLocation(own, i);
+                found++;
+            }
+        }
+
+        if (i < last)
+            hash = (hash - (unsigned char)text[i] * set->highPower) * HASH_BASE + (unsigned char)text[i + length];
+    }
+
+    own->positions += last - first + 1;
+    own->comparisons += compared;
+    context->blockFound[b] = found;
+}
+
+int searchTeamMulti(SearchContext* context, const char* text, int textLength, const char* const patterns[],
+    int patternCount, int patternLength, SearchResults results[], int counts[], SearchStats* stats)
+{
+    int p;
+    if (counts != NULL)
+    {
+        #pragma omp for
+        for (p = 0; p < patternCount; p++)
+        {
+            counts[p] = 0;
+        }
+    }
+
+    SearchSpan span;
+    if (textLength < patternLength || patternLength < 1 || patternCount < 1 ||
+        !searchSpan(context, textLength, patternLength, &span))
+        return searchNothing(stats);
+
+    int nBlocks = spanBlockCount(context, &span);
+    int b;
+
+    #pragma omp single
+    buildPatternSet(&context->patternSet, patterns, patternCount, patternLength);
+
+    beginSearch(context, nBlocks, stats);
+
+    if (context->placed)
+    {
+        #pragma omp for schedule(static,1) nowait
+        for (b = 0; b < nBlocks; b++)
+        {
+            searchMultiBlock(context, text, &span, nBlocks, b);
+        }
+    }
+    else
+    {
+        #pragma omp for schedule(dynamic,1) nowait
+        for (b = 0; b < nBlocks; b++)
+        {
+            searchMultiBlock(context, text, &span, nBlocks, b);
+        }
+    }
+
+    endSearch(context, stats);
+
+    // blocks are delivered in text order, so each pattern receives its locations in text order
+    #pragma omp single
+    {
+        long found = 0;
+        int r;
+        sumThreads(context, stats);
+
+        for (b = 0; b < nBlocks; b++)
+        {
+            int* blockResults = context->scratch[context->blockThread[b]].results + context->blockOffset[b];
+            for (r = 0; r < context->blockFound[b]; r++)
+            {
+                p = blockResults[2 * r];
+                if (counts != NULL)
+                    counts[p]++;
+                if (results != NULL)
+                    deliver(&results[p], blockResults[2 * r + 1]);
+            }
+            found += context->blockFound[b];
+        }
+
+        free(context->patternSet.hashes);
+        free(context->patternSet.table);
+        free(context->patternSet.next);
+        context->result = (int)found;
+    }
+
+    return context->result;
+}
+
+int searchText(SearchContext* context, int mode, const char* text, int textLength, const char* pattern,
+    int patternLength, int limit, SearchResults* results, SearchStats* stats)
+{
+    int result = 0;
+
+    #pragma omp parallel num_threads(context->threads)
+    {
+        int teamResult = searchTeam(context, mode, text, textLength, pattern, patternLength, limit, results, stats);
+
+        #pragma omp master
+        result = teamResult;
+    }
+
+    return result;
+}
+
+int searchSerial(int mode, const char* text, int textLength, const char* pattern, int patternLength, int limit,
+    int offset, SearchPoll poll, void* pollState, SearchResults* results, SearchStats* stats)
+{
+    ThreadScratch own;
+    memset(&own, 0, sizeof(own));
+    long busy = getNanos();
+
+    if (mode == SEARCH_ANY)
+        limit = 1;
+    else if (mode == SEARCH_FIRST)
+        limit = limit < 1 ? 1 : limit;
+    else
+        limit = INT_MAX;
+
+    // modes other than SEARCH_ANY and SEARCH_COUNT deliver their locations
+    int store = mode != SEARCH_ANY && mode != SEARCH_COUNT;
+
+    int found = 0;
+    if (textLength >= patternLength && patternLength > 0)
+        found = selectKernel(patternLength)(text, 0, textLength - patternLength, pattern, patternLength, limit, store,
+            &own, SERIAL_POLL_INTERVAL - 1, poll, pollState);
+
+    int r;
+    for (r = 0; r < own.used; r++)
+    {
+        deliver(results, own.results[r] + offset);
+    }
+    free(own.results);
+
+    if (stats != NULL)
+    {
+        memset(stats, 0, sizeof(SearchStats));
+        stats->positions = own.positions;
+        stats->comparisons = own.comparisons;
+        stats->workers = 1;
+        stats->busyNanos[0] = getNanos() - busy;
+        stats->workerPositions[0] = own.positions;
+    }
+
+    if (found < 0)
+        return SEARCH_STOPPED;
+    if (mode == SEARCH_ANY)
+        return found > 0;
+    return found;
+}
+
+int searchBaseWorkload(int proc, int nProc, int textLength)
+{
+    int nElements = textLength / nProc;
+    int remainder = textLength % nProc;
+
+    if (proc > ((nProc - 1) - remainder))
+        return nElements + 1;
+    return nElements;
+}
+
+void searchDivideWorkload(int nProc, int* procWork, int textLength, int patternLength)
+{
+    int i;
+    int start = 0;
+    for (i = 0; i < nProc; i++)
+    {
+        procWork[i] = searchBaseWorkload(i, nProc, textLength);
+        start += procWork[i];
+
+        // only patternLength - 1 extra characters are needed to detect patterns starting in this
+        // portion and ending in the next, so the overflow never passes the end of the text
+        int overflow = patternLength - 1;
+        if (overflow > textLength - start)
+            overflow = textLength - start;
+        if (overflow > 0)
+            procWork[i] += overflow;
+    }
+}
+
+void searchSetDisplacement(int nProc, int* displs, int textLength)
+{
+    int i;
+    // displacement at i dependent on i-1. We can set displs[0] to 0 since we know it starts there
+    displs[0] = 0;
+    for (i = 1; i < nProc; i++)
+    {
+        displs[i] = displs[i - 1] + searchBaseWorkload(i - 1, nProc, textLength);
+    }
+}
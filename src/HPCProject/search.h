@@ -0,0 +1,288 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: search.h
+// Description: Pattern searching library shared by project_OMP,
+// project_MPI and benchmark_OMP, and usable by other programs which
+// link libsearch.a. Texts and patterns are caller-owned buffers given
+// as a pointer and a length, which are searched in place and never
+// copied or freed by the library. Locations are delivered in text
+// order into a caller-provided array, to a callback, or both.
+//
+// Search modes:
+//      SEARCH_ANY      0   whether the pattern occurs, returns 1 or 0
+//      SEARCH_ALL      1   every occurrence, returns the number found
+//      SEARCH_COUNT    2   counts occurrences without delivering locations
+//      SEARCH_FIRST    3   the first limit occurrences in text order
+// Any other mode is treated as SEARCH_ALL.
+//
+// Entry points:
+//      searchText      searches with a team of OpenMP threads started for the call
+//      searchTeam      searches with the calling team, every thread of which must call it
+//      searchSerial    searches on the calling thread only, and can be stopped
+//                      early by a poll callback. Used by each MPI process
+//      searchTeamPacked
+//                      searches a text packed by searchPack, which stores texts
+//                      of at most 4 or 16 distinct bytes in 2 or 4 bits per symbol
+//      searchTeamMulti searches for every occurrence of many patterns of one length
+//                      together, in about the time of one search, using rolling hashes
+//      searchDivideWorkload, searchSetDisplacement
+//                      divide a text among processes, such that an occurrence
+//                      spanning two portions is found by exactly one
+//
+// Build: sh build_library, which writes libsearch.a. Programs using the
+// library are compiled with -fopenmp and linked with libsearch.a.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// incremented whenever a declaration in this file changes incompatibly
+#define SEARCH_API_VERSION 3
+
+#define SEARCH_ANY 0
+#define SEARCH_ALL 1
+#define SEARCH_COUNT 2
+#define SEARCH_FIRST 3
+
+// returned by searchSerial when the poll callback stopped the search
+#define SEARCH_STOPPED -1
+
+// most threads a search can use
+#define SEARCH_MAX_THREADS 256
+
+// called with the location of each occurrence, in text order
+typedef void (*SearchCallback)(void* state, int location);
+
+// called periodically by searchSerial, returns nonzero when the search should stop
+typedef int (*SearchPoll)(void* state);
+
+// where the locations of occurrences are delivered. Every member is set by the caller before
+// the search, except stored which the search updates
+typedef struct
+{
+    int* locations; // array the locations are stored in, or NULL
+    int capacity; // number of locations the array holds
+    int grow; // if nonzero, the array is grown with realloc when full and must be freed by the caller
+    int stored; // number of locations stored in the array
+    SearchCallback callback; // called with every location, or NULL
+    void* state; // passed to the callback
+} SearchResults;
+
+// instrumentation of a search
+typedef struct
+{
+    long positions; // text positions a comparison was started from
+    long comparisons; // character comparisons made
+    int workers; // threads used
+    long busyNanos[SEARCH_MAX_THREADS]; // time each thread spent searching
+    long workerPositions[SEARCH_MAX_THREADS]; // text positions searched by each thread
+} SearchStats;
+
+// state of the searches made by one team of threads, reused by every search
+typedef struct SearchContext SearchContext;
+
+// a text stored with 2 or 4 bits per symbol
+typedef struct SearchPacked SearchPacked;
+
+/// <summary>
+/// Creates the state used by searchText and searchTeam.
+/// </summary>
+/// <param name="threads">The number of threads searchText starts.</param>
+/// <returns>The new context, or NULL if there is not enough memory.</returns>
+SearchContext* searchCreate(int threads);
+
+/// <summary>
+/// Frees a context and everything it allocated.
+/// </summary>
+/// <param name="context">The context to free.</param>
+void searchDestroy(SearchContext* context);
+
+/// <summary>
+/// Sets the number of start positions in each block a thread searches at a time.
+/// </summary>
+/// <param name="context">The context to change.</param>
+/// <param name="blockSize">The number of start positions in a block.</param>
+void searchSetBlockSize(SearchContext* context, int blockSize);
+
+/// <summary>
+/// Limits the number of threads of a team which search: a text is divided into at most that many
+/// blocks, and only that many threads take chunks of SEARCH_FIRST. The other threads of the team
+/// still call the search, and wait for it.
+/// </summary>
+/// <param name="context">The context to change.</param>
+/// <param name="threads">The number of threads which search, 0 for every thread of the team.</param>
+void searchSetThreads(SearchContext* context, int threads);
+
+/// <summary>
+/// Restricts the team searches to occurrences lying wholly within a range of characters of the
+/// text. Locations are still offsets in the whole text. Only the start positions of the range are
+/// divided among the threads, except in placed searches, which keep the blocks of the whole text
+/// and search the part of each block within the range.
+/// </summary>
+/// <param name="context">The context to change.</param>
+/// <param name="start">The first character of the range.</param>
+/// <param name="end">One past the last character of the range, or -1 for the end of the text.</param>
+void searchSetRange(SearchContext* context, int start, int end);
+
+/// <summary>
+/// Sets whether block b of a text is always searched by thread b % threads, the thread which
+/// first touched it when the text was placed with searchBlockCount and searchBlockStart over its
+/// length and a static schedule of one block. Placed searches count their blocks the same way,
+/// from the length of the text, and divide its start positions among them. Otherwise blocks are given to whichever thread is free.
+/// </summary>
+/// <param name="context">The context to change.</param>
+/// <param name="placed">Nonzero to search each block on the thread that placed it.</param>
+void searchSetPlaced(SearchContext* context, int placed);
+
+/// <summary>
+/// Gets the number of blocks the start positions of a text are divided into.
+/// </summary>
+/// <param name="context">The context of the search.</param>
+/// <param name="positions">The number of start positions in the text.</param>
+/// <param name="threads">The number of threads searching.</param>
+/// <returns>The number of blocks.</returns>
+int searchBlockCount(SearchContext* context, int positions, int threads);
+
+/// <summary>
+/// Gets the first start position of a block.
+/// </summary>
+/// <param name="block">The block number, nBlocks gives the end of the last block.</param>
+/// <param name="nBlocks">The number of blocks.</param>
+/// <param name="positions">The number of start positions in the text.</param>
+/// <returns>The first start position of the block.</returns>
+int searchBlockStart(int block, int nBlocks, int positions);
+
+/// <summary>
+/// Searches a text with the calling team of OpenMP threads. Every thread of the team must call
+/// it with the same arguments, and every thread returns the same result. Locations are delivered
+/// by one thread once the search is complete.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="mode">The search mode.</param>
+/// <param name="text">The text to search.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="pattern">The pattern to search for.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="limit">The number of occurrences to find in SEARCH_FIRST.</param>
+/// <param name="results">Where to deliver locations, or NULL.</param>
+/// <param name="stats">Instrumentation of the search, or NULL.</param>
+/// <returns>The result of the search mode.</returns>
+int searchTeam(SearchContext* context, int mode, const char* text, int textLength, const char* pattern,
+    int patternLength, int limit, SearchResults* results, SearchStats* stats);
+
+/// <summary>
+/// Searches a text with a team of OpenMP threads started for the call.
+/// Takes the same arguments as searchTeam.
+/// </summary>
+int searchText(SearchContext* context, int mode, const char* text, int textLength, const char* pattern,
+    int patternLength, int limit, SearchResults* results, SearchStats* stats);
+
+/// <summary>
+/// Packs a text of at most 16 distinct bytes, in 2 bits per symbol if it has at most 4 distinct
+/// bytes and otherwise in 4 bits per symbol. The text is copied, so it may be freed afterwards.
+/// </summary>
+/// <param name="text">The text to pack.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <returns>The packed text, or NULL if the text has more than 16 distinct bytes, is empty,
+/// or there is not enough memory.</returns>
+SearchPacked* searchPack(const char* text, int textLength);
+
+/// <summary>
+/// Frees a packed text.
+/// </summary>
+/// <param name="packed">The packed text to free.</param>
+void searchFreePacked(SearchPacked* packed);
+
+/// <summary>
+/// Gets the number of symbols in a packed text.
+/// </summary>
+int searchPackedLength(const SearchPacked* packed);
+
+/// <summary>
+/// Gets the memory holding the symbols of a packed text, in bytes.
+/// </summary>
+long searchPackedBytes(const SearchPacked* packed);
+
+/// <summary>
+/// Searches a packed text with the calling team of OpenMP threads, comparing many symbols of
+/// the pattern with each 64-bit comparison. Takes the same arguments as searchTeam.
+/// </summary>
+int searchTeamPacked(SearchContext* context, int mode, const SearchPacked* text, const char* pattern,
+    int patternLength, int limit, SearchResults* results, SearchStats* stats);
+
+/// <summary>
+/// Finds every occurrence of many patterns of the same length in a text with the calling team
+/// of OpenMP threads, rolling a hash of the text once rather than searching for each pattern in
+/// turn. Every thread of the team must call it with the same arguments.
+/// </summary>
+/// <param name="context">The context of the team.</param>
+/// <param name="text">The text to search.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="patterns">The patterns to search for, which may repeat.</param>
+/// <param name="patternCount">The number of patterns.</param>
+/// <param name="patternLength">The length of every pattern.</param>
+/// <param name="results">Where to deliver the locations of each pattern, in text order, or NULL.</param>
+/// <param name="counts">Array to store the number of occurrences of each pattern, or NULL.</param>
+/// <param name="stats">Instrumentation of the search, or NULL.</param>
+/// <returns>The number of occurrences of every pattern.</returns>
+int searchTeamMulti(SearchContext* context, const char* text, int textLength, const char* const patterns[],
+    int patternCount, int patternLength, SearchResults results[], int counts[], SearchStats* stats);
+
+/// <summary>
+/// Searches a text on the calling thread only.
+/// </summary>
+/// <param name="mode">The search mode.</param>
+/// <param name="text">The text to search.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="pattern">The pattern to search for.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="limit">The number of occurrences to find in SEARCH_FIRST.</param>
+/// <param name="offset">Added to every location delivered, the position of the text in a larger text.</param>
+/// <param name="poll">Called every few thousand positions, the search stops when it returns nonzero. May be NULL.</param>
+/// <param name="pollState">Passed to poll.</param>
+/// <param name="results">Where to deliver locations, or NULL.</param>
+/// <param name="stats">Instrumentation of the search, or NULL.</param>
+/// <returns>The result of the search mode, or SEARCH_STOPPED if poll stopped the search,
+/// in which case no locations are delivered.</returns>
+int searchSerial(int mode, const char* text, int textLength, const char* pattern, int patternLength, int limit,
+    int offset, SearchPoll poll, void* pollState, SearchResults* results, SearchStats* stats);
+
+/// <summary>
+/// Gets the number of text positions a process is responsible for searching from.
+/// The text is divided evenly, with any remainder given to the last processes.
+/// </summary>
+/// <param name="proc">The process number.</param>
+/// <param name="nProc">The number of processes.</param>
+/// <param name="textLength">The length of the full text.</param>
+/// <returns>The base workload of the process.</returns>
+int searchBaseWorkload(int proc, int nProc, int textLength);
+
+/// <summary>
+/// Distributes a text among processes. Each portion is extended by patternLength - 1
+/// characters, never past the end of the text, so a pattern occurring across portions is
+/// found by exactly one process.
+/// </summary>
+/// <param name="nProc">The number of processes.</param>
+/// <param name="procWork">Array to contain the length of text given to each process.</param>
+/// <param name="textLength">The length of the full text.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+void searchDivideWorkload(int nProc, int* procWork, int textLength, int patternLength);
+
+/// <summary>
+/// Sets the displacement in the full text of each process' portion.
+/// </summary>
+/// <param name="nProc">The number of processes.</param>
+/// <param name="displs">Array to contain the displacement of each process.</param>
+/// <param name="textLength">The length of the full text.</param>
+void searchSetDisplacement(int nProc, int* displs, int textLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,312 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: server.h
+// Description: Query protocol of the project_OMP server mode, which
+// keeps the texts and patterns of a directory in memory and answers
+// queries from stdin or a Unix domain socket.
+//
+// A query is one line:
+//      mode text pattern [limit]
+// where mode, text and limit are as in a control entry, and pattern
+// is either a pattern number or ':' followed by the bytes of an ad hoc
+// pattern, such as "1 0 :ABBA". The answer to a query is the lines the
+// control entry would write to result_OMP.txt, with pattern -1 for an
+// ad hoc pattern, followed by an empty line. A query which cannot be
+// answered gets "error <reason>" followed by an empty line.
+//
+// Queries already waiting when a query is read are read with it as one
+// batch, of at most MAX_BATCH queries. The batch is searched grouped by
+// text, so that each text is read once while it is in cache, and the
+// answers are written in the order the queries arrived.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control.h"
+
+#ifndef DOS
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#endif
+
+#define MAX_BATCH 256
+#define MAX_QUERY_LENGTH 65536
+
+typedef struct
+{
+    int mode;
+    int textNumber;
+    int patternNumber; // -1 for an ad hoc pattern
+    int limit;
+    char* pattern; // bytes of an ad hoc pattern, owned by the query
+    int patternLength;
+    char* error; // why the query cannot be answered, or NULL
+    TestOutput output; // answer to the query, the lines the control entry would write
+} Query;
+
+// queries read from a client but not yet parsed
+typedef struct
+{
+    int fd;
+    char buffer[MAX_QUERY_LENGTH];
+    int start;
+    int end;
+    int eof;
+} ServerInput;
+
+/// <summary>
+/// Parses a query line.
+/// </summary>
+/// <param name="line">The line, without its newline.</param>
+/// <param name="query">The query to fill in.</param>
+/// <returns>1 if the line holds a query, 0 if it is empty.</returns>
+int parseQuery(char* line, Query* query)
+{
+    char token[MAX_QUERY_LENGTH];
+    int limit;
+
+    memset(query, 0, sizeof(Query));
+    query->limit = 1;
+
+    int readResult = sscanf(line, "%i %i %s %i", &query->mode, &query->textNumber, token, &limit);
+    if (readResult == EOF)
+        return 0;
+    if (readResult < 3)
+    {
+        query->error = "expected mode text pattern [limit]";
+        return 1;
+    }
+    if (readResult == 4)
+        query->limit = limit;
+
+    if (token[0] == ':')
+    {
+        query->patternNumber = -1;
+        query->patternLength = (int)strlen(token + 1);
+        query->pattern = (char*)malloc(query->patternLength + 1);
+        if (query->pattern == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(0);
+        }
+        memcpy(query->pattern, token + 1, query->patternLength + 1);
+        if (query->patternLength == 0)
+            query->error = "empty pattern";
+    }
+    else if (sscanf(token, "%i", &query->patternNumber) != 1)
+    {
+        query->error = "pattern must be a number or :bytes";
+    }
+    return 1;
+}
+
+/// <summary>
+/// Gets the next complete line already read from the client.
+/// </summary>
+/// <param name="input">The input of the client.</param>
+/// <returns>The line, valid until more input is read, or NULL if no complete line has been read.</returns>
+char* nextLine(ServerInput* input)
+{
+    char* newline = (char*)memchr(input->buffer + input->start, '\n', input->end - input->start);
+    if (newline == NULL)
+        return NULL;
+
+    char* line = input->buffer + input->start;
+    *newline = '\0';
+    if (newline > line && newline[-1] == '\r')
+        newline[-1] = '\0';
+    input->start = (int)(newline - input->buffer) + 1;
+    return line;
+}
+
+/// <summary>
+/// Reads more input from the client.
+/// </summary>
+/// <param name="input">The input of the client.</param>
+/// <param name="wait">Whether to wait for input, rather than only read input that is waiting.</param>
+/// <returns>1 if input was read, 0 if the client has closed, or -1 if no input is waiting.</returns>
+int fillInput(ServerInput* input, int wait)
+{
+#ifndef DOS
+    if (input->eof)
+        return 0;
+
+    // move the partial line to the start of the buffer, discarding it if it can never fit
+    memmove(input->buffer, input->buffer + input->start, input->end - input->start);
+    input->end -= input->start;
+    input->start = 0;
+    if (input->end == MAX_QUERY_LENGTH)
+        input->end = 0;
+
+    struct pollfd waiting = { input->fd, POLLIN, 0 };
+    if (poll(&waiting, 1, wait ? -1 : 0) <= 0)
+        return -1;
+
+    ssize_t count = read(input->fd, input->buffer + input->end, MAX_QUERY_LENGTH - input->end);
+    if (count > 0)
+    {
+        input->end += (int)count;
+        return 1;
+    }
+
+    // a final line without a newline is still a query
+    input->eof = 1;
+    if (input->end > 0 && input->buffer[input->end - 1] != '\n' && input->end < MAX_QUERY_LENGTH)
+    {
+        input->buffer[input->end++] = '\n';
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/// <summary>
+/// Reads a batch of queries. Waits for the first query, then takes every further query that is
+/// already waiting, so queries sent together are answered together.
+/// </summary>
+/// <param name="input">The input of the client.</param>
+/// <param name="batch">Array to store the queries.</param>
+/// <returns>The number of queries read, or -1 if the client has closed.</returns>
+int readBatch(ServerInput* input, Query batch[])
+{
+    int count = 0;
+    while (count < MAX_BATCH)
+    {
+        char* line = nextLine(input);
+        if (line != NULL)
+        {
+            count += parseQuery(line, &batch[count]);
+            continue;
+        }
+
+        int result = fillInput(input, count == 0);
+        if (result == 0 && count == 0)
+            return -1;
+        if (result <= 0)
+            break;
+    }
+    return count;
+}
+
+/// <summary>
+/// Orders a batch so that queries of the same text, and then of the same pattern, are searched
+/// one after another. Queries keep their arrival order within a group.
+/// </summary>
+/// <param name="batch">The queries.</param>
+/// <param name="count">The number of queries.</param>
+/// <param name="order">Array to store the order to search the queries in.</param>
+void orderBatch(Query batch[], int count, int order[])
+{
+    int i, j;
+    for (i = 0; i < count; i++)
+    {
+        int q = i;
+        for (j = i; j > 0; j--)
+        {
+            Query* previous = &batch[order[j - 1]];
+            if (previous->textNumber < batch[q].textNumber ||
+                (previous->textNumber == batch[q].textNumber && previous->patternNumber <= batch[q].patternNumber))
+                break;
+            order[j] = order[j - 1];
+        }
+        order[j] = q;
+    }
+}
+
+/// <summary>
+/// Writes all of a buffer to a file descriptor.
+/// </summary>
+/// <returns>1 if it was written, otherwise 0.</returns>
+int writeAll(int fd, char* data, int length)
+{
+#ifndef DOS
+    while (length > 0)
+    {
+        ssize_t count = write(fd, data, length);
+        if (count <= 0)
+            return 0;
+        data += count;
+        length -= (int)count;
+    }
+#endif
+    return 1;
+}
+
+/// <summary>
+/// Writes the answers of a batch in the order the queries arrived, and frees the queries.
+/// </summary>
+/// <param name="fd">The file descriptor of the client.</param>
+/// <param name="batch">The answered queries.</param>
+/// <param name="count">The number of queries.</param>
+void writeAnswers(int fd, Query batch[], int count)
+{
+    int q;
+    for (q = 0; q < count; q++)
+    {
+        if (batch[q].error != NULL)
+        {
+            char line[200];
+            int length = sprintf(line, "error %s\n", batch[q].error);
+            writeAll(fd, line, length);
+        }
+        else
+        {
+            writeAll(fd, batch[q].output.data, batch[q].output.length);
+        }
+        writeAll(fd, "\n", 1);
+
+        free(batch[q].output.data);
+        free(batch[q].pattern);
+    }
+}
+
+/// <summary>
+/// Creates a Unix domain socket listening at path, replacing any file already there.
+/// </summary>
+/// <param name="path">The path of the socket.</param>
+/// <returns>The listening socket, or -1 if it could not be created.</returns>
+int openListener(char* path)
+{
+#ifndef DOS
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "openListener: socket path too long %s\n", path);
+        return -1;
+    }
+
+    // a client closing before its answers are written must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0)
+    {
+        fprintf(stderr, "openListener: could not listen at %s\n", path);
+        close(listener);
+        return -1;
+    }
+    return listener;
+#else
+    fprintf(stderr, "openListener: Unix domain sockets are not available\n");
+    return -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,133 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: synthetic.h
+// Description: Functions shared by the input generator and the
+// benchmark for building reproducible synthetic texts and patterns.
+// A small xorshift generator is used instead of rand() so that the
+// same seed produces the same inputs on every platform.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// maximum number of distinct symbols a synthetic text may use
+#define MAX_ALPHABET 26
+
+unsigned long long syntheticSeed = 88172645463325252ULL;
+
+/// <summary>
+/// Seeds the synthetic random number generator.
+/// </summary>
+/// <param name="seed">The seed, 0 is replaced by the default seed.</param>
+void seedSynthetic(unsigned long long seed)
+{
+    syntheticSeed = seed ? seed : 88172645463325252ULL;
+}
+
+/// <summary>
+/// Gets the next value of the xorshift64 generator.
+/// </summary>
+/// <returns>A pseudo random 64 bit value.</returns>
+unsigned long long nextRandom()
+{
+    syntheticSeed ^= syntheticSeed << 13;
+    syntheticSeed ^= syntheticSeed >> 7;
+    syntheticSeed ^= syntheticSeed << 17;
+    return syntheticSeed;
+}
+
+/// <summary>
+/// Gets a pseudo random number in the range [0, limit).
+/// </summary>
+/// <param name="limit">The exclusive upper bound.</param>
+/// <returns>The random number.</returns>
+long randomBelow(long limit)
+{
+    if (limit <= 0)
+        return 0;
+    return (long)(nextRandom() % (unsigned long long)limit);
+}
+
+/// <summary>
+/// Fills a text with symbols drawn uniformly from an alphabet starting at 'A'.
+/// </summary>
+/// <param name="text">The text to fill.</param>
+/// <param name="length">The length of the text.</param>
+/// <param name="alphabet">The number of symbols in the alphabet.</param>
+void fillRandomText(char* text, long length, int alphabet)
+{
+    long i;
+    if (alphabet < 1)
+        alphabet = 1;
+    if (alphabet > MAX_ALPHABET)
+        alphabet = MAX_ALPHABET;
+    for (i = 0; i < length; i++)
+    {
+        text[i] = 'A' + (char)randomBelow(alphabet);
+    }
+}
+
+/// <summary>
+/// Fills a text with long runs of 'A' broken by a single 'B', like text0 of the
+/// small inputs. Patterns of the form AAA..AB then match all but their last
+/// character at almost every position, which is the worst case for the naive search.
+/// </summary>
+/// <param name="text">The text to fill.</param>
+/// <param name="length">The length of the text.</param>
+/// <param name="runLength">The number of characters in each run, including the 'B'.</param>
+void fillAdversarialText(char* text, long length, int runLength)
+{
+    long i;
+    if (runLength < 2)
+        runLength = 2;
+    for (i = 0; i < length; i++)
+    {
+        text[i] = ((i + 1) % runLength == 0) ? 'B' : 'A';
+    }
+}
+
+/// <summary>
+/// Fills a pattern of the form AAA..AX, where X is the final symbol.
+/// </summary>
+/// <param name="pattern">The pattern to fill.</param>
+/// <param name="length">The length of the pattern.</param>
+/// <param name="last">The final symbol of the pattern.</param>
+void fillAdversarialPattern(char* pattern, int length, char last)
+{
+    memset(pattern, 'A', length);
+    pattern[length - 1] = last;
+}
+
+/// <summary>
+/// Copies a pattern into a text at random positions so that the text contains roughly
+/// the requested number of matches per million characters.
+/// </summary>
+/// <param name="text">The text to plant the pattern in.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="pattern">The pattern to plant.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="matchesPerMillion">The density of planted matches.</param>
+/// <returns>The number of copies planted.</returns>
+long plantMatches(char* text, long textLength, const char* pattern, int patternLength, double matchesPerMillion)
+{
+    if (patternLength > textLength || matchesPerMillion <= 0)
+        return 0;
+
+    long count = (long)((double)textLength * matchesPerMillion / 1.0e6);
+    if (count == 0)
+        count = 1;
+
+    long i;
+    for (i = 0; i < count; i++)
+    {
+        long at = randomBelow(textLength - patternLength + 1);
+        memcpy(text + at, pattern, patternLength);
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/////////////////////////////////////////////////////////////////////
+//
+// Program: tuning.h
+// Description: Tuning profile of project_OMP and project_MPI, written
+// by their -calibrate modes and loaded when they start. The fastest
+// configuration of a search depends on the machine and on the lengths
+// of the text and pattern, so the calibration modes time every
+// candidate configuration on synthetic texts and keep the fastest for
+// each bucket of tests.
+//
+// A bucket is a (text size, pattern length, mode) class, where the size
+// class of a length is floor(log2(length)). A test uses the bucket of
+// its mode nearest its size classes, so a profile calibrated over a few
+// sizes covers any text.
+//
+// The profile is a text file with one bucket per line:
+//      size_class pattern_class mode block_size threads ranks seconds
+//      block_size      start positions in each block of a team search (project_OMP)
+//      threads         threads of the team which search (project_OMP)
+//      ranks           1 if the master searches alone, otherwise every
+//                      process searches (project_MPI)
+//      seconds         the time of the fastest configuration
+// A value of 0 keeps the program's default. Lines starting with # are
+// comments.
+//
+/////////////////////////////////////////////////////////////////////
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TUNING 512
+
+// the fastest configuration of a bucket
+typedef struct
+{
+    int sizeClass;
+    int patternClass;
+    int mode;
+    int blockSize;
+    int threads;
+    int ranks;
+    double seconds;
+} TuningEntry;
+
+typedef struct
+{
+    int count;
+    TuningEntry entries[MAX_TUNING];
+} TuningProfile;
+
+/// <summary>
+/// Gets the size class of a length, floor(log2(length)).
+/// </summary>
+/// <param name="length">The length, 0 is in class 0.</param>
+/// <returns>The size class.</returns>
+int lengthClass(long length)
+{
+    int c = 0;
+    while (length > 1)
+    {
+        length >>= 1;
+        c++;
+    }
+    return c;
+}
+
+/// <summary>
+/// Finds the bucket of a test: the bucket of its mode with the nearest size classes.
+/// </summary>
+/// <param name="profile">The profile.</param>
+/// <param name="textLength">The length of the text.</param>
+/// <param name="patternLength">The length of the pattern.</param>
+/// <param name="mode">The search mode.</param>
+/// <returns>The bucket, or NULL if the profile has none for the mode.</returns>
+TuningEntry* findTuning(TuningProfile* profile, long textLength, int patternLength, int mode)
+{
+    int sizeClass = lengthClass(textLength);
+    int patternClass = lengthClass(patternLength);
+    TuningEntry* best = NULL;
+    int bestDistance = 0;
+    int i;
+
+    for (i = 0; i < profile->count; i++)
+    {
+        TuningEntry* entry = &profile->entries[i];
+        if (entry->mode != mode)
+            continue;
+
+        int distance = abs(entry->sizeClass - sizeClass) + abs(entry->patternClass - patternClass);
+        if (best == NULL || distance < bestDistance)
+        {
+            best = entry;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+/// <summary>
+/// Gets the bucket of a size class, pattern class and mode, adding it if the profile has none.
+/// </summary>
+/// <param name="profile">The profile.</param>
+/// <param name="sizeClass">The size class of the texts.</param>
+/// <param name="patternClass">The size class of the patterns.</param>
+/// <param name="mode">The search mode.</param>
+/// <returns>The bucket, or NULL if the profile is full.</returns>
+TuningEntry* setTuning(TuningProfile* profile, int sizeClass, int patternClass, int mode)
+{
+    int i;
+    for (i = 0; i < profile->count; i++)
+    {
+        TuningEntry* entry = &profile->entries[i];
+        if (entry->sizeClass == sizeClass && entry->patternClass == patternClass && entry->mode == mode)
+            return entry;
+    }
+    if (profile->count == MAX_TUNING)
+        return NULL;
+
+    TuningEntry* entry = &profile->entries[profile->count++];
+    memset(entry, 0, sizeof(TuningEntry));
+    entry->sizeClass = sizeClass;
+    entry->patternClass = patternClass;
+    entry->mode = mode;
+    return entry;
+}
+
+/// <summary>
+/// Reads a profile written by saveTuning.
+/// </summary>
+/// <param name="profile">The profile to fill in.</param>
+/// <param name="fileName">The profile file.</param>
+/// <returns>The number of buckets read, or -1 if the file could not be opened.</returns>
+int loadTuning(TuningProfile* profile, char* fileName)
+{
+    char line[256];
+    FILE* f = fopen(fileName, "r");
+
+    profile->count = 0;
+    if (f == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        TuningEntry entry;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%i %i %i %i %i %i %lf", &entry.sizeClass, &entry.patternClass, &entry.mode,
+            &entry.blockSize, &entry.threads, &entry.ranks, &entry.seconds) < 6)
+            continue;
+
+        TuningEntry* bucket = setTuning(profile, entry.sizeClass, entry.patternClass, entry.mode);
+        if (bucket != NULL)
+            *bucket = entry;
+    }
+
+    fclose(f);
+    return profile->count;
+}
+
+/// <summary>
+/// Writes a profile, replacing the file only once it is complete so a program starting while
+/// it is written reads the old profile or the new one.
+/// </summary>
+/// <param name="profile">The profile.</param>
+/// <param name="fileName">The profile file.</param>
+/// <returns>1 if the profile was written, otherwise 0.</returns>
+int saveTuning(TuningProfile* profile, char* fileName)
+{
+    char tempName[1000];
+    int i;
+
+    sprintf(tempName, "%.990s.tmp", fileName);
+    FILE* f = fopen(tempName, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "saveTuning: could not open file %s\n", tempName);
+        return 0;
+    }
+
+    fprintf(f, "# size_class pattern_class mode block_size threads ranks seconds\n");
+    for (i = 0; i < profile->count; i++)
+    {
+        TuningEntry* entry = &profile->entries[i];
+        fprintf(f, "%i %i %i %i %i %i %.9f\n", entry->sizeClass, entry->patternClass, entry->mode,
+            entry->blockSize, entry->threads, entry->ranks, entry->seconds);
+    }
+    fclose(f);
+
+    // rename does not replace an existing file on DOS
+#ifdef DOS
+    remove(fileName);
+#endif
+    if (rename(tempName, fileName) != 0)
+    {
+        fprintf(stderr, "saveTuning: could not replace file %s\n", fileName);
+        return 0;
+    }
+    return 1;
+}
+
+#endif